@@ -0,0 +1,155 @@
+#include "byteorder.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// The source byte of each byte in a 16 byte vector of 'numbytes' values
+static void shuffle_mask(uint8_t mask[16], unsigned numbytes, ByteSwap op)
+{
+	const unsigned half = numbytes / 2;
+
+	for (unsigned i = 0; i < 16; ++i) {
+		const unsigned base = i - i % numbytes;
+		const unsigned k = i % numbytes;
+		unsigned src;
+
+		switch (op) {
+		case ByteSwap::All:
+			src = numbytes - 1 - k;
+			break;
+		case ByteSwap::Halves:
+			src = (k + half) % numbytes;
+			break;
+		case ByteSwap::WithinHalves:
+			src = k - k % half + (half - 1 - k % half);
+			break;
+		default:
+			src = k;
+			break;
+		}
+
+		mask[i] = base + src;
+	}
+}
+
+template<typename T, T (*Conv)(T, Endianness)>
+static void convert_scalar(uint8_t* dst, const uint8_t* src, size_t count, Endianness endianness)
+{
+	for (size_t i = 0; i < count; ++i) {
+		T v;
+		memcpy(&v, src + i * sizeof(T), sizeof(T));
+		v = Conv(v, endianness);
+		memcpy(dst + i * sizeof(T), &v, sizeof(T));
+	}
+}
+
+static void convert_tail(uint8_t* dst, const uint8_t* src, size_t count, unsigned numbytes,
+			 Endianness endianness)
+{
+	switch (numbytes) {
+	case 2:
+		convert_scalar<uint16_t, byteorder16>(dst, src, count, endianness);
+		break;
+	case 4:
+		convert_scalar<uint32_t, byteorder32>(dst, src, count, endianness);
+		break;
+	case 8:
+		convert_scalar<uint64_t, byteorder64>(dst, src, count, endianness);
+		break;
+	default:
+		FAIL("Illegal data regsize '%d'", numbytes);
+	}
+}
+
+// Each of the functions below shuffles whole vectors and returns the number
+// of bytes done, the caller converts the rest
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static size_t shuffle_avx2(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t mask[16])
+{
+	const __m256i m = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)mask));
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, m));
+	}
+
+	return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t shuffle_ssse3(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t mask[16])
+{
+	const __m128i m = _mm_loadu_si128((const __m128i*)mask);
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, m));
+	}
+
+	return i;
+}
+#elif defined(__aarch64__)
+static size_t shuffle_neon(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t mask[16])
+{
+	const uint8x16_t m = vld1q_u8(mask);
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16)
+		vst1q_u8(dst + i, vqtbl1q_u8(vld1q_u8(src + i), m));
+
+	return i;
+}
+#endif
+
+static size_t shuffle(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t mask[16])
+{
+#if defined(__x86_64__)
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+
+	if (has_avx2)
+		return shuffle_avx2(dst, src, len, mask);
+	if (has_ssse3)
+		return shuffle_ssse3(dst, src, len, mask);
+	return 0;
+#elif defined(__aarch64__)
+	return shuffle_neon(dst, src, len, mask);
+#else
+	return 0;
+#endif
+}
+
+void convert_byte_order(void* dst, const void* src, size_t count, unsigned numbytes,
+			Endianness endianness)
+{
+	const ByteSwap op = byte_swap_op(endianness);
+
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	const size_t len = count * numbytes;
+
+	if (numbytes == 1 || op == ByteSwap::None ||
+	    (numbytes == 2 && op == ByteSwap::WithinHalves)) {
+		if (d != s)
+			memmove(d, s, len);
+		return;
+	}
+
+	uint8_t mask[16];
+	shuffle_mask(mask, numbytes, op);
+
+	const size_t done = shuffle(d, s, len, mask);
+
+	convert_tail(d + done, s + done, (len - done) / numbytes, numbytes, endianness);
+}
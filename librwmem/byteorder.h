@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "helpers.h"
+
+/*
+ * Conversion between the device's and the host's byte order. For every
+ * Endianness the conversion is a fixed permutation of the bytes of a value
+ * which is its own inverse, so the same functions convert both ways.
+ * Endianness::Default is treated as Little. For 16 bit values the "words"
+ * of the swapped modes are single bytes, i.e. BigSwapped is Little and
+ * LittleSwapped is Big.
+ */
+
+enum class ByteSwap
+{
+	None,		// bytes as is
+	All,		// reverse all bytes
+	Halves,		// swap the two halves
+	WithinHalves,	// reverse the bytes within each half
+};
+
+static inline ByteSwap byte_swap_op(Endianness endianness)
+{
+	switch (endianness) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	case Endianness::Big:
+		return ByteSwap::All;
+	case Endianness::BigSwapped:
+		return ByteSwap::WithinHalves;
+	case Endianness::LittleSwapped:
+		return ByteSwap::Halves;
+#else
+	case Endianness::Default:
+	case Endianness::Little:
+		return ByteSwap::All;
+	case Endianness::BigSwapped:
+		return ByteSwap::Halves;
+	case Endianness::LittleSwapped:
+		return ByteSwap::WithinHalves;
+#endif
+	default:
+		return ByteSwap::None;
+	}
+}
+
+static inline uint16_t byteorder16(uint16_t v, Endianness endianness)
+{
+	switch (byte_swap_op(endianness)) {
+	case ByteSwap::All:
+	case ByteSwap::Halves:
+		return __builtin_bswap16(v);
+	default:
+		return v;
+	}
+}
+
+static inline uint32_t byteorder32(uint32_t v, Endianness endianness)
+{
+	switch (byte_swap_op(endianness)) {
+	case ByteSwap::All:
+		return __builtin_bswap32(v);
+	case ByteSwap::Halves:
+		return (v << 16) | (v >> 16);
+	case ByteSwap::WithinHalves:
+		v = __builtin_bswap32(v);
+		return (v << 16) | (v >> 16);
+	default:
+		return v;
+	}
+}
+
+static inline uint64_t byteorder64(uint64_t v, Endianness endianness)
+{
+	switch (byte_swap_op(endianness)) {
+	case ByteSwap::All:
+		return __builtin_bswap64(v);
+	case ByteSwap::Halves:
+		return (v << 32) | (v >> 32);
+	case ByteSwap::WithinHalves:
+		v = __builtin_bswap64(v);
+		return (v << 32) | (v >> 32);
+	default:
+		return v;
+	}
+}
+
+// Store the low 'numbytes' bytes of 'value' to 'buf' as a host order value
+static inline void put_host(void* buf, uint64_t value, unsigned numbytes)
+{
+	switch (numbytes) {
+	case 1:
+		*(uint8_t*)buf = value;
+		break;
+	case 2: {
+		uint16_t v = value;
+		memcpy(buf, &v, 2);
+		break;
+	}
+	case 4: {
+		uint32_t v = value;
+		memcpy(buf, &v, 4);
+		break;
+	}
+	case 8:
+		memcpy(buf, &value, 8);
+		break;
+	default:
+		abort();
+	}
+}
+
+// Load a host order value of 'numbytes' bytes from 'buf'
+static inline uint64_t get_host(const void* buf, unsigned numbytes)
+{
+	switch (numbytes) {
+	case 1:
+		return *(const uint8_t*)buf;
+	case 2: {
+		uint16_t v;
+		memcpy(&v, buf, 2);
+		return v;
+	}
+	case 4: {
+		uint32_t v;
+		memcpy(&v, buf, 4);
+		return v;
+	}
+	case 8: {
+		uint64_t v;
+		memcpy(&v, buf, 8);
+		return v;
+	}
+	default:
+		abort();
+	}
+}
+
+// Convert 'count' values of 'numbytes' bytes from 'src' to 'dst', which
+// may be the same buffer. Uses byte shuffles where the CPU has them.
+void convert_byte_order(void* dst, const void* src, size_t count, unsigned numbytes,
+			Endianness endianness);
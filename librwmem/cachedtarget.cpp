@@ -0,0 +1,308 @@
+#include "cachedtarget.h"
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "helpers.h"
+
+using namespace std;
+
+// The live caches. exit() is only reached through errors, often a failed
+// transfer, so the bus is not touched at exit. The writes not made are
+// reported instead.
+static vector<CachedTarget*> s_caches;
+
+void CachedTarget::report_unsynced()
+{
+	for (const CachedTarget* c : s_caches) {
+		for (const auto& p : c->m_entries) {
+			if (p.second.dirty)
+				fprintf(stderr, "Cached write not made: %#" PRIx64 " = %#" PRIx64 "\n",
+					p.first, p.second.value);
+		}
+	}
+}
+
+CachedTarget::CachedTarget(shared_ptr<ITarget> target, CacheMode mode)
+	: m_target(target), m_mode(mode),
+	  m_num_hits(0), m_num_misses(0), m_num_skipped_writes(0)
+{
+	static bool registered = false;
+
+	if (!registered) {
+		atexit(report_unsynced);
+		registered = true;
+	}
+
+	s_caches.push_back(this);
+}
+
+CachedTarget::~CachedTarget()
+{
+	auto it = std::find(s_caches.begin(), s_caches.end(), this);
+	if (it != s_caches.end())
+		s_caches.erase(it);
+
+	sync();
+}
+
+bool CachedTarget::is_volatile(uint64_t addr, unsigned numbytes) const
+{
+	// The ranges do not overlap, so only the last one starting within
+	// the register can contain it
+	auto it = m_volatile.upper_bound(addr + numbytes - 1);
+
+	if (it == m_volatile.begin())
+		return false;
+
+	--it;
+
+	return it->second > addr;
+}
+
+// Drop the cached registers overlapping the range, writing back dirty ones
+void CachedTarget::evict(uint64_t addr, uint64_t length) const
+{
+	// Registers are at most 8 bytes
+	auto it = m_entries.lower_bound(addr >= 7 ? addr - 7 : 0);
+
+	while (it != m_entries.end() && it->first < addr + length) {
+		const Entry& e = it->second;
+
+		if (it->first + e.numbytes <= addr) {
+			++it;
+			continue;
+		}
+
+		if (e.dirty)
+			m_target->write(it->first, e.numbytes, e.value);
+
+		it = m_entries.erase(it);
+	}
+}
+
+// The cached register, or null. Cached registers of another size overlapping
+// it are dropped, so the entries never overlap.
+CachedTarget::Entry* CachedTarget::find(uint64_t addr, unsigned numbytes) const
+{
+	auto it = m_entries.find(addr);
+
+	if (it != m_entries.end() && it->second.numbytes == numbytes)
+		return &it->second;
+
+	evict(addr, numbytes);
+
+	return nullptr;
+}
+
+uint64_t CachedTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	const bool vol = is_volatile(addr, numbytes);
+
+	if (!vol) {
+		const Entry* e = find(addr, numbytes);
+
+		if (e) {
+			m_num_hits++;
+			return e->value;
+		}
+	}
+
+	m_num_misses++;
+
+	uint64_t v = m_target->read(addr, numbytes);
+
+	if (!vol)
+		m_entries[addr] = { numbytes, v, false };
+
+	return v;
+}
+
+void CachedTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	if (is_volatile(addr, numbytes)) {
+		m_target->write(addr, numbytes, value);
+		return;
+	}
+
+	Entry* e = find(addr, numbytes);
+
+	if (e && e->value == value) {
+		m_num_skipped_writes++;
+		return;
+	}
+
+	const bool write_back = m_mode == CacheMode::WriteBack;
+
+	if (!write_back)
+		m_target->write(addr, numbytes, value);
+
+	m_entries[addr] = { numbytes, value, write_back };
+}
+
+void CachedTarget::read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const
+{
+	vector<size_t> misses;
+	vector<uint64_t> miss_addrs;
+	vector<unsigned> miss_sizes;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!is_volatile(addrs[i], sizes[i])) {
+			const Entry* e = find(addrs[i], sizes[i]);
+
+			if (e) {
+				m_num_hits++;
+				values[i] = e->value;
+				continue;
+			}
+		}
+
+		misses.push_back(i);
+		miss_addrs.push_back(addrs[i]);
+		miss_sizes.push_back(sizes[i]);
+	}
+
+	if (misses.empty())
+		return;
+
+	vector<uint64_t> miss_values(misses.size());
+
+	m_target->read_batch(miss_addrs.data(), miss_sizes.data(), miss_values.data(), misses.size());
+
+	m_num_misses += misses.size();
+
+	for (size_t j = 0; j < misses.size(); ++j) {
+		const uint64_t addr = miss_addrs[j];
+		const unsigned numbytes = miss_sizes[j];
+
+		values[misses[j]] = miss_values[j];
+
+		if (!is_volatile(addr, numbytes)) {
+			find(addr, numbytes);
+			m_entries[addr] = { numbytes, miss_values[j], false };
+		}
+	}
+}
+
+void CachedTarget::read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
+{
+	vector<uint64_t> addrs(count);
+	vector<unsigned> sizes(count, numbytes);
+	vector<uint64_t> values(count);
+
+	for (size_t i = 0; i < count; ++i)
+		addrs[i] = addr + i * numbytes;
+
+	read_batch(addrs.data(), sizes.data(), values.data(), count);
+
+	uint8_t* p = (uint8_t*)buf;
+
+	for (size_t i = 0; i < count; ++i, p += numbytes)
+		put_host(p, values[i], numbytes);
+}
+
+void CachedTarget::write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+{
+	if (m_mode == CacheMode::WriteBack) {
+		ITarget::write_block(addr, numbytes, count, buf);
+		return;
+	}
+
+	const uint8_t* p = (const uint8_t*)buf;
+	bool changed = false;
+
+	for (size_t i = 0; i < count && !changed; ++i) {
+		const uint64_t a = addr + i * numbytes;
+		const Entry* e = is_volatile(a, numbytes) ? nullptr : find(a, numbytes);
+
+		changed = !e || e->value != get_host(p + i * numbytes, numbytes);
+	}
+
+	if (!changed) {
+		m_num_skipped_writes += count;
+		return;
+	}
+
+	// The whole block in one go, so that the target can use its block
+	// writes, like i2c page writes
+	m_target->write_block(addr, numbytes, count, buf);
+
+	for (size_t i = 0; i < count; ++i) {
+		const uint64_t a = addr + i * numbytes;
+
+		if (!is_volatile(a, numbytes)) {
+			find(a, numbytes);
+			m_entries[a] = { numbytes, get_host(p + i * numbytes, numbytes), false };
+		}
+	}
+}
+
+uint32_t CachedTarget::read32(uint64_t addr) const
+{
+	return read(addr, 4);
+}
+
+void CachedTarget::write32(uint64_t addr, uint32_t value)
+{
+	write(addr, 4, value);
+}
+
+void CachedTarget::set_volatile(uint64_t addr, uint64_t length)
+{
+	evict(addr, length);
+
+	// Merge with the overlapping and adjacent ranges
+	uint64_t start = addr;
+	uint64_t end = addr + length;
+
+	auto it = m_volatile.upper_bound(start);
+
+	if (it != m_volatile.begin() && prev(it)->second >= start)
+		--it;
+
+	while (it != m_volatile.end() && it->first <= end) {
+		start = min(start, it->first);
+		end = max(end, it->second);
+		it = m_volatile.erase(it);
+	}
+
+	m_volatile[start] = end;
+}
+
+// Dirty registers are written in runs of consecutive registers of the same
+// size, with one write_block() each
+void CachedTarget::sync()
+{
+	vector<uint8_t> buf;
+	auto it = m_entries.begin();
+
+	while (it != m_entries.end()) {
+		if (!it->second.dirty) {
+			++it;
+			continue;
+		}
+
+		const uint64_t addr = it->first;
+		const unsigned numbytes = it->second.numbytes;
+		size_t count = 0;
+
+		buf.clear();
+
+		for (; it != m_entries.end() && it->second.dirty && it->second.numbytes == numbytes &&
+		       it->first == addr + count * numbytes; ++it, ++count) {
+			buf.resize((count + 1) * numbytes);
+			put_host(&buf[count * numbytes], it->second.value, numbytes);
+			it->second.dirty = false;
+		}
+
+		m_target->write_block(addr, numbytes, count, buf.data());
+	}
+}
+
+void CachedTarget::invalidate()
+{
+	m_entries.clear();
+}
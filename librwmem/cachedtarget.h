@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+#include <memory>
+
+#include "itarget.h"
+
+enum class CacheMode
+{
+	WriteThrough,	// writes go to the target at once
+	WriteBack,	// writes are kept in the cache until sync()
+};
+
+/*
+ * Wraps a slow target, like an i2c device, and caches the values of its
+ * registers, in the manner of the kernel's regmap cache. Reads of cached
+ * registers and writes of the value a register already has do not reach
+ * the target at all, so read-modify-writes of several fields of a register
+ * only read it once.
+ *
+ * Registers the device itself changes, like status registers, must be
+ * marked volatile with set_volatile(). They are never cached.
+ *
+ * The cache is not tied to the target's mapping. With write-back, sync()
+ * writes the dirty registers in address order, so the target must be able
+ * to access all of them then, as i2c targets, which have no mapping, can.
+ * The destructor syncs too. exit() does not, it only reports the writes
+ * not made.
+ */
+class CachedTarget : public ITarget
+{
+public:
+	CachedTarget(std::shared_ptr<ITarget> target, CacheMode mode);
+	~CachedTarget();
+
+	void map(uint64_t offset, uint64_t length) { m_target->map(offset, length); }
+	void unmap() { m_target->unmap(); }
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const;
+	void write(uint64_t addr, unsigned numbytes, uint64_t value);
+
+	// Misses are read from the target with one read_batch()
+	void read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const;
+	void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const;
+	void write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf);
+	bool batches_reads() const { return m_target->batches_reads(); }
+
+	uint32_t read32(uint64_t addr) const;
+	void write32(uint64_t addr, uint32_t value);
+
+	// Never cache the registers in the given range
+	void set_volatile(uint64_t addr, uint64_t length);
+
+	// Write the dirty registers to the target
+	void sync();
+
+	// Forget all cached values, e.g. after the device has been reset.
+	// Writes not synced yet are lost.
+	void invalidate();
+
+	uint64_t num_hits() const { return m_num_hits; }
+	uint64_t num_misses() const { return m_num_misses; }
+	uint64_t num_skipped_writes() const { return m_num_skipped_writes; }
+
+private:
+	struct Entry
+	{
+		unsigned numbytes;
+		uint64_t value;
+		bool dirty;
+	};
+
+	std::shared_ptr<ITarget> m_target;
+	CacheMode m_mode;
+
+	mutable std::map<uint64_t, Entry> m_entries;
+
+	// Volatile ranges, start -> end
+	std::map<uint64_t, uint64_t> m_volatile;
+
+	mutable uint64_t m_num_hits;
+	mutable uint64_t m_num_misses;
+	uint64_t m_num_skipped_writes;
+
+	static void report_unsynced();
+
+	bool is_volatile(uint64_t addr, unsigned numbytes) const;
+	Entry* find(uint64_t addr, unsigned numbytes) const;
+	void evict(uint64_t addr, uint64_t length) const;
+};
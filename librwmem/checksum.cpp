@@ -0,0 +1,255 @@
+#include "checksum.h"
+
+#include <stdexcept>
+#include <string.h>
+#include <endian.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "helpers.h"
+
+using namespace std;
+
+/*
+ * Slicing-by-8 tables for the reflected CRC32 polynomials, for the CPUs
+ * without crc32 instructions
+ */
+struct CrcTables
+{
+	uint32_t t[8][256];
+
+	CrcTables(uint32_t poly)
+	{
+		for (unsigned i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (unsigned j = 0; j < 8; ++j)
+				c = (c >> 1) ^ (c & 1 ? poly : 0);
+			t[0][i] = c;
+		}
+
+		for (unsigned i = 0; i < 256; ++i)
+			for (unsigned s = 1; s < 8; ++s)
+				t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+	}
+};
+
+static uint32_t crc32_sw(const CrcTables& tbl, uint32_t crc, const uint8_t* p, size_t len)
+{
+	const auto& t = tbl.t;
+
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		v = le64toh(v) ^ crc;
+
+		crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^
+		      t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff] ^
+		      t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^
+		      t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+	return crc;
+}
+
+static uint32_t crc32_ieee(uint32_t crc, const uint8_t* p, size_t len)
+{
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = __crc32d(crc, v);
+	}
+
+	while (len--)
+		crc = __crc32b(crc, *p++);
+
+	return crc;
+#else
+	static const CrcTables tables(0xedb88320);
+	return crc32_sw(tables, crc, p, len);
+#endif
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len)
+{
+	uint64_t c = crc;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+
+	while (len--)
+		c = _mm_crc32_u8(c, *p++);
+
+	return c;
+}
+#endif
+
+static uint32_t crc32c(uint32_t crc, const uint8_t* p, size_t len)
+{
+#if defined(__x86_64__)
+	static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+
+	if (has_sse42)
+		return crc32c_sse42(crc, p, len);
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+	}
+
+	while (len--)
+		crc = __crc32cb(crc, *p++);
+
+	return crc;
+#endif
+
+	static const CrcTables tables(0x82f63b78);
+	return crc32_sw(tables, crc, p, len);
+}
+
+static const uint64_t xxh_p1 = 11400714785074694791ULL;
+static const uint64_t xxh_p2 = 14029467366897019727ULL;
+static const uint64_t xxh_p3 = 1609587929392839161ULL;
+static const uint64_t xxh_p4 = 9650029242287828579ULL;
+static const uint64_t xxh_p5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t v, unsigned r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t read_le64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return le64toh(v);
+}
+
+static inline uint64_t read_le32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return le32toh(v);
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * xxh_p2;
+	acc = rotl64(acc, 31);
+	return acc * xxh_p1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * xxh_p1 + xxh_p4;
+}
+
+static uint64_t xxh64(const uint8_t* p, size_t len)
+{
+	const uint8_t* end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = xxh_p1 + xxh_p2;
+		uint64_t v2 = xxh_p2;
+		uint64_t v3 = 0;
+		uint64_t v4 = -xxh_p1;
+
+		for (; p + 32 <= end; p += 32) {
+			v1 = xxh64_round(v1, read_le64(p));
+			v2 = xxh64_round(v2, read_le64(p + 8));
+			v3 = xxh64_round(v3, read_le64(p + 16));
+			v4 = xxh64_round(v4, read_le64(p + 24));
+		}
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	} else {
+		h = xxh_p5;
+	}
+
+	h += len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, read_le64(p));
+		h = rotl64(h, 27) * xxh_p1 + xxh_p4;
+	}
+
+	if (p + 4 <= end) {
+		h ^= read_le32(p) * xxh_p1;
+		h = rotl64(h, 23) * xxh_p2 + xxh_p3;
+		p += 4;
+	}
+
+	for (; p < end; ++p) {
+		h ^= *p * xxh_p5;
+		h = rotl64(h, 11) * xxh_p1;
+	}
+
+	h ^= h >> 33;
+	h *= xxh_p2;
+	h ^= h >> 29;
+	h *= xxh_p3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+const char* checksum_name(ChecksumType type)
+{
+	switch (type) {
+	case ChecksumType::CRC32:
+		return "crc32";
+	case ChecksumType::CRC32C:
+		return "crc32c";
+	case ChecksumType::XXH64:
+		return "xxh64";
+	}
+
+	FAIL("bad checksum type");
+}
+
+ChecksumType checksum_parse(const string& name)
+{
+	for (ChecksumType t : { ChecksumType::CRC32, ChecksumType::CRC32C, ChecksumType::XXH64 })
+		if (name == checksum_name(t))
+			return t;
+
+	throw runtime_error("unknown checksum type '" + name + "'");
+}
+
+uint64_t checksum(ChecksumType type, const void* data, size_t len)
+{
+	const uint8_t* p = (const uint8_t*)data;
+
+	switch (type) {
+	case ChecksumType::CRC32:
+		return ~crc32_ieee(~0u, p, len);
+	case ChecksumType::CRC32C:
+		return ~crc32c(~0u, p, len);
+	case ChecksumType::XXH64:
+		return xxh64(p, len);
+	}
+
+	FAIL("bad checksum type");
+}
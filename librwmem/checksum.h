@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+enum class ChecksumType
+{
+	CRC32,		// IEEE 802.3, as zlib and the crc32 tool
+	CRC32C,		// Castagnoli, as iSCSI and ext4
+	XXH64,		// xxHash64, seed 0
+};
+
+const char* checksum_name(ChecksumType type);
+ChecksumType checksum_parse(const std::string& name);
+
+// Checksum of 'len' bytes. CRC32C uses the CPU's crc32 instructions if
+// available, as does CRC32 on arm64.
+uint64_t checksum(ChecksumType type, const void* data, size_t len);
@@ -0,0 +1,372 @@
+#include "cosim.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "helpers.h"
+#include "byteorder.h"
+
+using namespace std;
+
+// How long to spin before sleeping in the kernel. A model answering within
+// this never sees a system call on either side.
+static const uint64_t spin_ns = 50000;
+
+// How often a sleeping side wakes up to check the other side is still there
+static const long poll_ns = 100000000;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// The futexes are shared between processes, so no FUTEX_PRIVATE_FLAG
+static void futex_wait(atomic<uint32_t>* addr, uint32_t val, long timeout_ns)
+{
+	struct timespec ts { 0, timeout_ns };
+	syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+static void futex_wake(atomic<uint32_t>* addr)
+{
+	syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static bool reached(uint32_t counter, uint32_t seq)
+{
+	return (int32_t)(counter - seq) >= 0;
+}
+
+// Wait until 'counter' reaches 'seq'. While sleeping, 'keep_waiting' is
+// called every poll_ns, and the wait is given up if it returns false.
+template<typename F>
+static bool wait_until(atomic<uint32_t>& counter, atomic<uint32_t>& sleeping, uint32_t seq,
+		       F keep_waiting)
+{
+	if (reached(counter.load(memory_order_acquire), seq))
+		return true;
+
+	// With one CPU the other side cannot make progress while we spin
+	static const bool spin = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+
+	const uint64_t start = now_ns();
+
+	for (unsigned n = 1; spin; ++n) {
+		cpu_relax();
+
+		if (reached(counter.load(memory_order_acquire), seq))
+			return true;
+
+		if (n % 64 == 0 && now_ns() - start > spin_ns)
+			break;
+	}
+
+	// The waker stores the counter and then loads the flag, we store the
+	// flag and then load the counter, so one of us sees the other
+	bool ok = true;
+
+	while (true) {
+		sleeping.store(1, memory_order_seq_cst);
+
+		const uint32_t v = counter.load(memory_order_seq_cst);
+		if (reached(v, seq))
+			break;
+
+		futex_wait(&counter, v, poll_ns);
+
+		if (!keep_waiting()) {
+			ok = reached(counter.load(memory_order_acquire), seq);
+			break;
+		}
+	}
+
+	sleeping.store(0, memory_order_relaxed);
+
+	return ok;
+}
+
+static void publish(atomic<uint32_t>& counter, atomic<uint32_t>& sleeping, uint32_t value)
+{
+	counter.store(value, memory_order_seq_cst);
+
+	if (sleeping.load(memory_order_seq_cst))
+		futex_wake(&counter);
+}
+
+static bool process_exists(pid_t pid)
+{
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+CoSimTarget::CoSimTarget(const string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	ERR_ON_ERRNO(fd < 0, "Failed to open shm '%s'", name.c_str());
+
+	struct stat st;
+	int r = fstat(fd, &st);
+	ERR_ON_ERRNO(r, "Failed to get shm stat");
+
+	if ((size_t)st.st_size < sizeof(CoSimHeader))
+		throw runtime_error("Bad co-sim ring size");
+
+	void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	ERR_ON_ERRNO(base == MAP_FAILED, "Failed to mmap shm '%s'", name.c_str());
+
+	close(fd);
+
+	m_hdr = (CoSimHeader*)base;
+	m_len = st.st_size;
+
+	if (m_hdr->magic != RWMEM_COSIM_MAGIC)
+		throw runtime_error("Bad co-sim ring magic number");
+
+	if (m_hdr->version != RWMEM_COSIM_VERSION)
+		throw runtime_error("Bad co-sim ring version");
+
+	atomic_thread_fence(memory_order_acquire);
+
+	if (m_len < sizeof(CoSimHeader) + (size_t)m_hdr->num_slots * sizeof(CoSimRequest))
+		throw runtime_error("Bad co-sim ring size");
+
+	ERR_ON(!process_exists(m_hdr->model_pid), "Co-sim model process %d has exited",
+	       m_hdr->model_pid);
+
+	int32_t client = m_hdr->client_pid.load();
+
+	ERR_ON(client && process_exists(client), "Co-sim ring '%s' is in use by process %d",
+	       name.c_str(), client);
+	ERR_ON(!m_hdr->client_pid.compare_exchange_strong(client, getpid()),
+	       "Co-sim ring '%s' is in use by process %d", name.c_str(), client);
+
+	m_mask = m_hdr->num_slots - 1;
+
+	// A previous client may have exited with requests in flight
+	m_next = m_reaped = m_hdr->posted.load(memory_order_relaxed);
+	wait_completed(m_next);
+}
+
+CoSimTarget::~CoSimTarget()
+{
+	sync();
+
+	m_hdr->client_pid.store(0);
+
+	munmap(m_hdr, m_len);
+}
+
+void CoSimTarget::doorbell() const
+{
+	if (m_hdr->posted.load(memory_order_relaxed) != m_next)
+		publish(m_hdr->posted, m_hdr->model_sleeping, m_next);
+}
+
+// Wait for request 'seq - 1' and check the status of all completed requests
+void CoSimTarget::wait_completed(uint32_t seq) const
+{
+	const pid_t pid = m_hdr->model_pid;
+
+	wait_until(m_hdr->completed, m_hdr->client_sleeping, seq, [pid]() {
+		ERR_ON(!process_exists(pid), "Co-sim model process %d has exited", pid);
+		return true;
+	});
+
+	const uint32_t done = m_hdr->completed.load(memory_order_acquire);
+
+	for (; m_reaped != done; ++m_reaped) {
+		const CoSimRequest& req = m_hdr->slots()[m_reaped & m_mask];
+
+		ERR_ON(req.status, "Co-sim model failed to %s %u bytes at %#" PRIx64,
+		       req.op == (uint8_t)CoSimOp::Write ? "write" : "read", req.size, req.addr);
+	}
+}
+
+CoSimRequest& CoSimTarget::post(CoSimOp op, uint64_t addr, unsigned numbytes, uint64_t value) const
+{
+	if (m_next - m_reaped > m_mask) {
+		// Ring full, let the model see what we have and wait for a slot
+		doorbell();
+		wait_completed(m_reaped + 1);
+	}
+
+	CoSimRequest& req = m_hdr->slots()[m_next & m_mask];
+
+	req.op = (uint8_t)op;
+	req.size = numbytes;
+	req.status = 0;
+	req.addr = addr;
+	req.value = value;
+
+	m_next++;
+
+	return req;
+}
+
+void CoSimTarget::sync() const
+{
+	doorbell();
+	wait_completed(m_next);
+}
+
+uint64_t CoSimTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	const CoSimRequest& req = post(CoSimOp::Read, addr, numbytes, 0);
+
+	sync();
+
+	return req.value;
+}
+
+void CoSimTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	post(CoSimOp::Write, addr, numbytes, value);
+
+	doorbell();
+}
+
+// Reads are posted a ring full at a time, so that no response is overwritten
+// before it is collected
+
+void CoSimTarget::read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const
+{
+	const size_t num_slots = m_mask + 1;
+
+	for (size_t first = 0; first < count; first += num_slots) {
+		const size_t n = min(count - first, num_slots);
+		const uint32_t start = m_next;
+
+		for (size_t i = 0; i < n; ++i)
+			post(CoSimOp::Read, addrs[first + i], sizes[first + i], 0);
+
+		sync();
+
+		for (size_t i = 0; i < n; ++i)
+			values[first + i] = m_hdr->slots()[(start + i) & m_mask].value;
+	}
+}
+
+void CoSimTarget::read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
+{
+	const size_t num_slots = m_mask + 1;
+	uint8_t* p = (uint8_t*)buf;
+
+	for (size_t first = 0; first < count; first += num_slots) {
+		const size_t n = min(count - first, num_slots);
+		const uint32_t start = m_next;
+
+		for (size_t i = 0; i < n; ++i)
+			post(CoSimOp::Read, addr + (first + i) * numbytes, numbytes, 0);
+
+		sync();
+
+		for (size_t i = 0; i < n; ++i)
+			put_host(p + (first + i) * numbytes,
+				 m_hdr->slots()[(start + i) & m_mask].value, numbytes);
+	}
+}
+
+void CoSimTarget::write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+{
+	const uint8_t* p = (const uint8_t*)buf;
+
+	for (size_t i = 0; i < count; ++i)
+		post(CoSimOp::Write, addr + i * numbytes, numbytes, get_host(p + i * numbytes, numbytes));
+
+	doorbell();
+}
+
+uint32_t CoSimTarget::read32(uint64_t addr) const
+{
+	return read(addr, 4);
+}
+
+void CoSimTarget::write32(uint64_t addr, uint32_t value)
+{
+	write(addr, 4, value);
+}
+
+CoSimModel::CoSimModel(const string& name, uint32_t num_slots)
+	: m_name(name), m_running(true), m_num_served(0)
+{
+	// round up to a power of two
+	num_slots = 1u << fls(max(num_slots, 2u) * 2 - 1);
+
+	m_len = sizeof(CoSimHeader) + (size_t)num_slots * sizeof(CoSimRequest);
+
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	ERR_ON_ERRNO(fd < 0, "Failed to open shm '%s'", name.c_str());
+
+	int r = ftruncate(fd, m_len);
+	ERR_ON_ERRNO(r, "Failed to size shm '%s'", name.c_str());
+
+	void* base = mmap(NULL, m_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	ERR_ON_ERRNO(base == MAP_FAILED, "Failed to mmap shm '%s'", name.c_str());
+
+	close(fd);
+
+	m_hdr = (CoSimHeader*)base;
+
+	m_hdr->version = RWMEM_COSIM_VERSION;
+	m_hdr->num_slots = num_slots;
+	m_hdr->model_pid = getpid();
+
+	// The counters, flags and slots are zero filled by ftruncate
+
+	atomic_thread_fence(memory_order_release);
+	m_hdr->magic = RWMEM_COSIM_MAGIC;
+}
+
+CoSimModel::~CoSimModel()
+{
+	munmap(m_hdr, m_len);
+	shm_unlink(m_name.c_str());
+}
+
+void CoSimModel::serve(Handler handler)
+{
+	CoSimRequest* slots = m_hdr->slots();
+	const uint32_t mask = m_hdr->num_slots - 1;
+
+	uint32_t next = m_hdr->completed.load(memory_order_relaxed);
+
+	while (m_running) {
+		if (!wait_until(m_hdr->posted, m_hdr->model_sleeping, next + 1,
+				[this]() { return m_running.load(); }))
+			break;
+
+		// Everything posted so far is served before completing, so a
+		// batch is answered with a single wakeup
+		const uint32_t end = m_hdr->posted.load(memory_order_acquire);
+
+		for (; next != end; ++next) {
+			CoSimRequest& req = slots[next & mask];
+
+			req.status = handler(req) ? 0 : 1;
+			m_num_served++;
+		}
+
+		publish(m_hdr->completed, m_hdr->client_sleeping, end);
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+
+#include "itarget.h"
+
+const uint32_t RWMEM_COSIM_MAGIC = 0x00e1c051;
+const uint32_t RWMEM_COSIM_VERSION = 1;
+
+/*
+ * Shared memory layout: CoSimHeader, then num_slots CoSimRequests.
+ *
+ * The ring has a single client, which posts requests, and a single model,
+ * which completes them in order, writing the response into the request's
+ * slot. 'posted' and 'completed' count requests modulo 2^32 and are also the
+ * futex words the two sides sleep on. A side sleeping in the kernel sets its
+ * 'sleeping' flag first, so the other side only makes the wake system call
+ * when someone actually waits. Both sides spin for a while before sleeping,
+ * so a busy model answers without any system calls.
+ */
+enum class CoSimOp : uint8_t
+{
+	Read = 0,
+	Write = 1,
+};
+
+struct CoSimRequest
+{
+	uint8_t op;
+	uint8_t size;		// bytes
+	uint8_t status;		// set by the model, 0 is success
+	uint8_t reserved[5];
+	uint64_t addr;
+	uint64_t value;		// the value to write, or the value read
+};
+
+struct CoSimHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_slots;	// power of two
+	int32_t model_pid;
+	std::atomic<int32_t> client_pid;	// 0 if no client
+
+	alignas(64) std::atomic<uint32_t> posted;
+	std::atomic<uint32_t> model_sleeping;
+
+	alignas(64) std::atomic<uint32_t> completed;
+	std::atomic<uint32_t> client_sleeping;
+
+	CoSimRequest* slots() { return (CoSimRequest*)(this + 1); }
+};
+
+/*
+ * The client side: a target whose registers are served by a model process.
+ * Reads wait for the response. Writes are posted and only wait if the ring
+ * is full; a failed write is reported by a later access. Batch and block
+ * reads post all requests before ringing the doorbell once.
+ */
+class CoSimTarget : public ITarget
+{
+public:
+	CoSimTarget(const std::string& name);
+	~CoSimTarget();
+
+	void map(uint64_t offset, uint64_t length) { }
+	void unmap() { }
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const;
+	void write(uint64_t addr, unsigned numbytes, uint64_t value);
+
+	void read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const;
+	void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const;
+	void write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf);
+	bool batches_reads() const { return true; }
+
+	uint32_t read32(uint64_t addr) const;
+	void write32(uint64_t addr, uint32_t value);
+
+	// Wait until the model has completed all posted requests
+	void sync() const;
+
+private:
+	CoSimHeader* m_hdr;
+	size_t m_len;
+	uint32_t m_mask;
+
+	// Requests posted, and requests whose status has been checked
+	mutable uint32_t m_next;
+	mutable uint32_t m_reaped;
+
+	CoSimRequest& post(CoSimOp op, uint64_t addr, unsigned numbytes, uint64_t value) const;
+	void doorbell() const;
+	void wait_completed(uint32_t seq) const;
+};
+
+/*
+ * The model side: creates the segment and serves the requests of a
+ * CoSimTarget. The handler is called for each request in order and fills
+ * in req.value for reads. Returning false fails the request.
+ */
+class CoSimModel
+{
+public:
+	typedef std::function<bool(CoSimRequest& req)> Handler;
+
+	CoSimModel(const std::string& name, uint32_t num_slots);
+	~CoSimModel();
+
+	// Serve requests until stop() is called. stop() may be called from
+	// a signal handler.
+	void serve(Handler handler);
+	void stop() { m_running = false; }
+
+	uint64_t num_served() const { return m_num_served; }
+
+private:
+	std::string m_name;
+	CoSimHeader* m_hdr;
+	size_t m_len;
+
+	std::atomic<bool> m_running;
+	uint64_t m_num_served;
+};
@@ -0,0 +1,263 @@
+#include "dumpfile.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "helpers.h"
+#include "lz.h"
+#include "byteorder.h"
+
+using namespace std;
+
+DumpWriter::DumpWriter(const string& filename, uint32_t frame_size)
+	: m_frame_size(frame_size), m_offset(0), m_bytes_in(0)
+{
+	if (filename == "-") {
+		m_fd = STDOUT_FILENO;
+	} else {
+		m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		ERR_ON_ERRNO(m_fd < 0, "Failed to open dump file '%s'", filename.c_str());
+	}
+
+	DumpHeader hdr { };
+	hdr.magic = htole32(RWMEM_DUMP_MAGIC);
+	hdr.version = htole32(RWMEM_DUMP_VERSION);
+	hdr.frame_size = htole32(frame_size);
+
+	write_all(&hdr, sizeof(hdr));
+}
+
+DumpWriter::~DumpWriter()
+{
+	close();
+}
+
+void DumpWriter::write_all(const void* data, size_t len)
+{
+	const uint8_t* p = (const uint8_t*)data;
+
+	while (len) {
+		ssize_t l = ::write(m_fd, p, len);
+		ERR_ON_ERRNO(l < 0, "Failed to write dump");
+
+		p += l;
+		len -= l;
+		m_offset += l;
+	}
+}
+
+void DumpWriter::encode(uint64_t addr, const uint8_t* data, uint32_t length, DumpFrame& frame)
+{
+	frame.addr = addr;
+	frame.length = length;
+
+	if (all_of(data, data + length, [](uint8_t b) { return b == 0; })) {
+		frame.type = DumpFrameType::Zero;
+		frame.data.clear();
+		return;
+	}
+
+	frame.data.resize(lz_compress_bound(length));
+
+	// Store incompressible frames as is
+	size_t l = lz_compress(data, length, frame.data.data(), length - 1);
+
+	if (l) {
+		frame.type = DumpFrameType::LZ;
+		frame.data.resize(l);
+	} else {
+		frame.type = DumpFrameType::Raw;
+		frame.data.assign(data, data + length);
+	}
+}
+
+void DumpWriter::write(const DumpFrame& frame)
+{
+	FAIL_IF(m_fd < 0, "dump already closed");
+	FAIL_IF(frame.length > m_frame_size, "dump frame too large");
+
+	DumpIndexEntry e;
+	e.set(frame.addr, m_offset, frame.length, frame.data.size(), frame.type);
+	m_index.push_back(e);
+
+	write_all(frame.data.data(), frame.data.size());
+
+	m_bytes_in += frame.length;
+}
+
+void DumpWriter::close()
+{
+	if (m_fd < 0)
+		return;
+
+	DumpFooter footer;
+	footer.index_offset = htole64(m_offset);
+	footer.num_frames = htole64(m_index.size());
+	footer.magic = htole32(RWMEM_DUMP_MAGIC);
+	footer.version = htole32(RWMEM_DUMP_VERSION);
+
+	write_all(m_index.data(), m_index.size() * sizeof(DumpIndexEntry));
+	write_all(&footer, sizeof(footer));
+
+	if (m_fd != STDOUT_FILENO)
+		::close(m_fd);
+
+	m_fd = -1;
+}
+
+DumpTarget::DumpTarget(const string& filename, Endianness data_endianness)
+	: m_data_endianness(data_endianness), m_cached_frame(~(size_t)0)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	ERR_ON_ERRNO(fd < 0, "Failed to open dump file '%s'", filename.c_str());
+
+	struct stat st;
+	int r = fstat(fd, &st);
+	ERR_ON_ERRNO(r, "Failed to get dump file stat");
+
+	m_len = st.st_size;
+
+	if (m_len < sizeof(DumpHeader) + sizeof(DumpFooter))
+		throw runtime_error("Bad dump file size");
+
+	void* base = mmap(NULL, m_len, PROT_READ, MAP_SHARED, fd, 0);
+	ERR_ON_ERRNO(base == MAP_FAILED, "Failed to mmap dump file '%s'", filename.c_str());
+
+	close(fd);
+
+	m_data = (const uint8_t*)base;
+
+	const DumpHeader* hdr = (const DumpHeader*)m_data;
+	const DumpFooter* footer = (const DumpFooter*)(m_data + m_len - sizeof(DumpFooter));
+
+	if (le32toh(hdr->magic) != RWMEM_DUMP_MAGIC || le32toh(footer->magic) != RWMEM_DUMP_MAGIC)
+		throw runtime_error("Bad dump magic number");
+
+	if (le32toh(hdr->version) != RWMEM_DUMP_VERSION || le32toh(footer->version) != RWMEM_DUMP_VERSION)
+		throw runtime_error("Bad dump version");
+
+	const uint64_t index_offset = le64toh(footer->index_offset);
+	const uint64_t num_frames = le64toh(footer->num_frames);
+
+	if (index_offset > m_len - sizeof(DumpFooter) ||
+	    num_frames > (m_len - sizeof(DumpFooter) - index_offset) / sizeof(DumpIndexEntry))
+		throw runtime_error("Bad dump index");
+
+	const DumpIndexEntry* index = (const DumpIndexEntry*)(m_data + index_offset);
+	m_index.assign(index, index + num_frames);
+
+	for (const DumpIndexEntry& e : m_index) {
+		if (e.offset() + e.comp_length() > index_offset)
+			throw runtime_error("Bad dump index");
+	}
+
+	sort(m_index.begin(), m_index.end(),
+	     [](const DumpIndexEntry& a, const DumpIndexEntry& b) { return a.addr() < b.addr(); });
+}
+
+DumpTarget::~DumpTarget()
+{
+	munmap((void*)m_data, m_len);
+}
+
+void DumpTarget::map(uint64_t offset, uint64_t length)
+{
+}
+
+void DumpTarget::unmap()
+{
+}
+
+const DumpIndexEntry& DumpTarget::find_frame(uint64_t addr) const
+{
+	auto it = upper_bound(m_index.begin(), m_index.end(), addr,
+			      [](uint64_t a, const DumpIndexEntry& e) { return a < e.addr(); });
+
+	ERR_ON(it == m_index.begin() || addr >= (it - 1)->addr() + (it - 1)->length(),
+	       "Address %#" PRIx64 " not in dump", addr);
+
+	return *(it - 1);
+}
+
+const uint8_t* DumpTarget::frame_data(const DumpIndexEntry& e) const
+{
+	const size_t idx = &e - m_index.data();
+
+	if (idx == m_cached_frame)
+		return m_frame.data();
+
+	const uint8_t* src = m_data + e.offset();
+
+	switch (e.type()) {
+	case DumpFrameType::Raw:
+		ERR_ON(e.comp_length() != e.length(), "Corrupt dump frame at %#" PRIx64, e.addr());
+		return src;
+
+	case DumpFrameType::Zero:
+		m_frame.assign(e.length(), 0);
+		break;
+
+	case DumpFrameType::LZ:
+		m_frame.resize(e.length());
+		ERR_ON(!lz_decompress(src, e.comp_length(), m_frame.data(), e.length()),
+		       "Corrupt dump frame at %#" PRIx64, e.addr());
+		break;
+
+	default:
+		ERR("Bad dump frame type at %#" PRIx64, e.addr());
+	}
+
+	m_cached_frame = idx;
+
+	return m_frame.data();
+}
+
+void DumpTarget::read_bytes(uint64_t addr, uint8_t* buf, size_t len) const
+{
+	while (len) {
+		const DumpIndexEntry& e = find_frame(addr);
+		const uint64_t offset = addr - e.addr();
+		const size_t l = min((uint64_t)len, e.length() - offset);
+
+		memcpy(buf, frame_data(e) + offset, l);
+
+		addr += l;
+		buf += l;
+		len -= l;
+	}
+}
+
+uint64_t DumpTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	uint8_t buf[8];
+	read_bytes(addr, buf, numbytes);
+
+	return device_to_host(buf, numbytes, m_data_endianness);
+}
+
+void DumpTarget::read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
+{
+	read_bytes(addr, (uint8_t*)buf, count * numbytes);
+	convert_byte_order(buf, buf, count, numbytes, m_data_endianness);
+}
+
+void DumpTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	ERR("Cannot write to a dump");
+}
+
+uint32_t DumpTarget::read32(uint64_t addr) const
+{
+	return read(addr, 4);
+}
+
+void DumpTarget::write32(uint64_t addr, uint32_t value)
+{
+	write(addr, 4, value);
+}
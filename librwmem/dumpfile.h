@@ -0,0 +1,147 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <endian.h>
+
+#include "itarget.h"
+
+const uint32_t RWMEM_DUMP_MAGIC = 0x00e1d0c0;
+const uint32_t RWMEM_DUMP_VERSION = 1;
+
+/*
+ * Compressed dump file layout: DumpHeader, the frames, an index with a
+ * DumpIndexEntry per frame, and a DumpFooter pointing to the index. The
+ * index is at the end so that a dump can be streamed to a pipe, and it lets
+ * readers decompress only the frames they need. All fields are little
+ * endian.
+ */
+
+enum class DumpFrameType : uint32_t
+{
+	Zero = 0,	// all zeroes, no data
+	Raw = 1,	// uncompressed
+	LZ = 2,		// LZ4 block format
+};
+
+struct __attribute__(( packed )) DumpHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frame_size;	// maximum uncompressed frame size
+	uint32_t reserved;
+};
+
+struct __attribute__(( packed )) DumpIndexEntry
+{
+	uint64_t addr() const { return le64toh(m_addr); }
+	uint64_t offset() const { return le64toh(m_offset); }
+	uint32_t length() const { return le32toh(m_length); }
+	uint32_t comp_length() const { return le32toh(m_comp_length); }
+	DumpFrameType type() const { return (DumpFrameType)le32toh(m_type); }
+
+	void set(uint64_t addr, uint64_t offset, uint32_t length, uint32_t comp_length, DumpFrameType type)
+	{
+		m_addr = htole64(addr);
+		m_offset = htole64(offset);
+		m_length = htole32(length);
+		m_comp_length = htole32(comp_length);
+		m_type = htole32((uint32_t)type);
+		m_reserved = 0;
+	}
+
+private:
+	uint64_t m_addr;	// target address of the frame's first byte
+	uint64_t m_offset;	// file offset of the frame data
+	uint32_t m_length;	// uncompressed bytes
+	uint32_t m_comp_length;	// bytes in the file
+	uint32_t m_type;
+	uint32_t m_reserved;
+};
+
+struct __attribute__(( packed )) DumpFooter
+{
+	uint64_t index_offset;
+	uint64_t num_frames;
+	uint32_t magic;
+	uint32_t version;
+};
+
+// A frame encoded by DumpWriter::encode(), ready to be written
+struct DumpFrame
+{
+	uint64_t addr;
+	uint32_t length;
+	DumpFrameType type;
+	std::vector<uint8_t> data;
+};
+
+/*
+ * Writes a compressed dump, to a file or with filename "-" to stdout. Frames
+ * must be added in address order and be at most frame_size bytes.
+ */
+class DumpWriter
+{
+public:
+	DumpWriter(const std::string& filename, uint32_t frame_size);
+	~DumpWriter();
+
+	// Compress a frame. Thread safe, so frames can be encoded in parallel.
+	static void encode(uint64_t addr, const uint8_t* data, uint32_t length, DumpFrame& frame);
+
+	void write(const DumpFrame& frame);
+
+	// Write the index and the footer
+	void close();
+
+	uint64_t bytes_in() const { return m_bytes_in; }
+	uint64_t bytes_out() const { return m_offset; }
+
+private:
+	int m_fd;
+	uint32_t m_frame_size;
+	uint64_t m_offset;
+	uint64_t m_bytes_in;
+
+	std::vector<DumpIndexEntry> m_index;
+
+	void write_all(const void* data, size_t len);
+};
+
+/*
+ * A read-only target over a compressed dump. Frames are decompressed when
+ * accessed, and the last one is cached.
+ */
+class DumpTarget : public ITarget
+{
+public:
+	DumpTarget(const std::string& filename, Endianness data_endianness);
+	~DumpTarget();
+
+	void map(uint64_t offset, uint64_t length);
+	void unmap();
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const;
+	void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const;
+	void write(uint64_t addr, unsigned numbytes, uint64_t value);
+
+	uint32_t read32(uint64_t addr) const;
+	void write32(uint64_t addr, uint32_t value);
+
+	// Copy 'len' bytes from the dump
+	void read_bytes(uint64_t addr, uint8_t* buf, size_t len) const;
+
+private:
+	const uint8_t* m_data;
+	size_t m_len;
+
+	Endianness m_data_endianness;
+
+	std::vector<DumpIndexEntry> m_index;	// sorted by address
+
+	mutable size_t m_cached_frame;
+	mutable std::vector<uint8_t> m_frame;
+
+	const DumpIndexEntry& find_frame(uint64_t addr) const;
+	const uint8_t* frame_data(const DumpIndexEntry& e) const;
+};
@@ -5,14 +5,18 @@
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <endian.h>
+#include <stdexcept>
 
 #include "helpers.h"
+#include "byteorder.h"
 
 using namespace std;
 
@@ -45,6 +49,42 @@ int parse_u64(const std::string& str, uint64_t *value)
 	return 0;
 }
 
+int parse_duration(const std::string& str, uint64_t *ns)
+{
+	static const struct {
+		const char* suffix;
+		uint64_t mult;
+	} units[] = {
+		{ "ns", 1 },
+		{ "us", 1000 },
+		{ "ms", 1000000 },
+		{ "s", 1000000000 },
+		{ "", 1000000 },
+	};
+
+	double v;
+	char *endptr;
+
+	v = strtod(str.c_str(), &endptr);
+	if (endptr == str.c_str() || !isfinite(v) || v < 0)
+		return -EINVAL;
+
+	for (const auto& u : units) {
+		if (strcmp(endptr, u.suffix) == 0) {
+			const double t = v * u.mult;
+
+			// 2^64, the first value not fitting in the result
+			if (t >= 18446744073709551616.0)
+				return -EINVAL;
+
+			*ns = (uint64_t)t;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
 int fls(uint64_t num)
 {
 	int i = 0;
@@ -85,3 +125,48 @@ bool file_exists(const string& name)
 	struct stat buffer;
 	return (stat (name.c_str(), &buffer) == 0);
 }
+
+uint64_t device_to_host(uint8_t buf[], unsigned numbytes, Endianness endianness)
+{
+	switch (numbytes) {
+	case 1:
+		return buf[0];
+	case 2: {
+		uint16_t v;
+		memcpy(&v, buf, 2);
+		return byteorder16(v, endianness);
+	}
+	case 4: {
+		uint32_t v;
+		memcpy(&v, buf, 4);
+		return byteorder32(v, endianness);
+	}
+	case 8: {
+		uint64_t v;
+		memcpy(&v, buf, 8);
+		return byteorder64(v, endianness);
+	}
+	default:
+		abort();
+	}
+}
+
+void host_to_device(uint64_t value, unsigned numbytes, uint8_t buf[], Endianness endianness)
+{
+	switch (numbytes) {
+	case 1:
+		buf[0] = value & 0xff;
+		break;
+	case 2:
+		put_host(buf, byteorder16(value, endianness), 2);
+		break;
+	case 4:
+		put_host(buf, byteorder32(value, endianness), 4);
+		break;
+	case 8:
+		put_host(buf, byteorder64(value, endianness), 8);
+		break;
+	default:
+		abort();
+	}
+}
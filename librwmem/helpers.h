@@ -48,6 +48,9 @@ std::vector<std::string> split(const std::string &s, char delim);
 
 int parse_u64(const std::string& str, uint64_t *value);
 
+// Parse a duration with an optional ns/us/ms/s suffix, default unit is ms
+int parse_duration(const std::string& str, uint64_t *ns);
+
 int fls(uint64_t num);
 #define DIV_ROUND_UP(n,d) (((n) + (d) - 1) / (d))
 
@@ -67,3 +70,7 @@ enum class Endianness
 	BigSwapped = 3,		// Big endian, 16/32 bit words swapped
 	LittleSwapped = 4,	// Little endian, 16/32 bit words swapped
 };
+
+// Convert a value between host order and the byte order used by the device
+uint64_t device_to_host(uint8_t buf[], unsigned numbytes, Endianness endianness);
+void host_to_device(uint64_t value, unsigned numbytes, uint8_t buf[], Endianness endianness);
@@ -1,7 +1,11 @@
 #include "i2ctarget.h"
 #include "helpers.h"
+#include "byteorder.h"
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -12,11 +16,19 @@
 
 using namespace std;
 
+// The i2c-dev limit for the length of a single message
+static const size_t i2c_max_msg_len = 8192;
+
+// How long to retry a write to a device busy with an earlier page write
+static const unsigned page_write_retries = 100;
+static const unsigned page_write_retry_us = 100;
+
 I2CTarget::I2CTarget(unsigned adapter_nr, uint16_t i2c_addr,
 	       uint16_t addr_len, Endianness addr_endianness, Endianness data_endianness)
 	: m_i2c_addr(i2c_addr),
 	  m_address_bytes(addr_len), m_address_endianness(addr_endianness),
-	  m_data_endianness(data_endianness)
+	  m_data_endianness(data_endianness), m_page_size(0), m_burst_len(0),
+	  m_max_msgs(I2C_RDWR_IOCTL_MAX_MSGS)
 {
 	string name("/dev/i2c-");
 	name += to_string(adapter_nr);
@@ -36,171 +48,169 @@ I2CTarget::~I2CTarget()
 	close(m_fd);
 }
 
-static uint32_t swap32(uint32_t v)
+// One register, or with bursts a run of consecutive registers, to read
+struct I2CTarget::Read
 {
-	return (v << 16) | (v >> 16);
+	uint64_t addr;
+	uint8_t* buf;
+	size_t len;
+	size_t end;	// index of the register after the run, for read_batch()
+};
+
+uint64_t I2CTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	uint8_t data_buf[8] { };
+	Read rd { addr, data_buf, numbytes, 0 };
+
+	read_packed(&rd, 1);
+
+	return device_to_host(data_buf, numbytes, m_data_endianness);
 }
 
-static uint64_t swap64(uint64_t v)
+int I2CTarget::transfer(struct i2c_msg* msgs, size_t nmsgs) const
 {
-	return (v << 32) | (v >> 32);
+	struct i2c_rdwr_ioctl_data data;
+	data.msgs = msgs;
+	data.nmsgs = nmsgs;
+
+	return ioctl(m_fd, I2C_RDWR, &data);
 }
 
-static uint64_t device_to_host(uint8_t buf[], unsigned numbytes, Endianness endianness)
+/*
+ * Do the reads with as few ioctls as possible, each an address write and a
+ * data read, combined with repeated starts. Returns how many reads were done:
+ * all of them, or fewer if the adapter could not do a read this long and the
+ * burst length was halved, so the caller has to split the rest again.
+ *
+ * The kernel checks the adapter's quirks, like a maximum number of messages
+ * or a maximum read length, before touching the bus, so a rejected ioctl is
+ * safe to retry in smaller pieces.
+ */
+size_t I2CTarget::read_packed(const Read* reads, size_t count) const
 {
-	switch (numbytes) {
-	case 1:
-		return buf[0];
-	case 2: {
-		uint16_t v = *((uint16_t*)buf);
-
-		switch (endianness) {
-		case Endianness::Big:
-			return be16toh(v);
-		case Endianness::Little:
-			return le16toh(v);
-		default:
-			throw invalid_argument("Bad endianness");
-		}
-	}
-	case 4: {
-		uint32_t v = *((uint32_t*)buf);
-
-		switch (endianness) {
-		case Endianness::Big:
-			return be32toh(v);
-		case Endianness::Little:
-			return le32toh(v);
-		case Endianness::BigSwapped:
-			return swap32(be32toh(v));
-		case Endianness::LittleSwapped:
-			return swap32(le32toh(v));
-		default:
-			throw invalid_argument("Bad endianness");
+	uint8_t addr_bufs[I2C_RDWR_IOCTL_MAX_MSGS / 2][8];
+	struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+	size_t first = 0;
+
+	while (first < count) {
+		const size_t n = min(count - first, (size_t)max(m_max_msgs / 2, 1u));
+
+		for (size_t i = 0; i < n; ++i) {
+			const Read& rd = reads[first + i];
+			struct i2c_msg* m = &msgs[i * 2];
+
+			host_to_device(rd.addr, m_address_bytes, addr_bufs[i], m_address_endianness);
+
+			m[0].addr = m_i2c_addr;
+			m[0].flags = 0;
+			m[0].len = m_address_bytes;
+			m[0].buf = addr_bufs[i];
+
+			m[1].addr = m_i2c_addr;
+			m[1].flags = I2C_M_RD;
+			m[1].len = rd.len;
+			m[1].buf = rd.buf;
 		}
-	}
-	case 8: {
-		uint64_t v = *((uint64_t*)buf);
-
-		switch (endianness) {
-		case Endianness::Big:
-			return be64toh(v);
-		case Endianness::Little:
-			return le64toh(v);
-		case Endianness::BigSwapped:
-			return swap64(be64toh(v));
-		case Endianness::LittleSwapped:
-			return swap64(le64toh(v));
-		default:
-			throw invalid_argument("Bad endianness");
+
+		int r = transfer(msgs, n * 2);
+
+		if (r < 0 && errno == EOPNOTSUPP) {
+			// Too many messages, if the first read alone goes through
+			if (n > 1 && transfer(msgs, 2) >= 0) {
+				m_max_msgs = n;
+				first++;
+				continue;
+			}
+
+			// Else too long a read
+			if (m_burst_len && reads[first].len > 8) {
+				m_burst_len = reads[first].len / 2;
+				return first;
+			}
 		}
+
+		ERR_ON_ERRNO(r < 0, "i2c transfer failed");
+
+		first += n;
 	}
-	default:
-		abort();
-	}
+
+	return count;
 }
 
-static void host_to_device(uint64_t value, unsigned numbytes, uint8_t buf[], Endianness endianness)
+// Bytes per burst read, a multiple of 'align'
+size_t I2CTarget::burst_chunk(unsigned align) const
 {
-	switch (numbytes) {
-	case 1:
-		buf[0] = value & 0xff;
-		break;
-	case 2: {
-		uint16_t v = (uint16_t)value;
-		uint16_t* p = (uint16_t*)buf;
-
-		switch (endianness) {
-		case Endianness::Big:
-			*p = htobe16(v);
-			break;
-		case Endianness::Little:
-			*p = htole16(v);
-			break;
-		default:
-			throw invalid_argument("Bad endianness");
-		}
+	const size_t len = min((size_t)m_burst_len, i2c_max_msg_len);
 
-		break;
-	}
-	case 4: {
-		uint32_t v = (uint32_t)value;
-		uint32_t* p = (uint32_t*)buf;
-
-		switch (endianness) {
-		case Endianness::Big:
-			*p = htobe32(v);
-			break;
-		case Endianness::Little:
-			*p = htole32(v);
-			break;
-		case Endianness::BigSwapped:
-			*p = swap32(htobe32(v));
-			break;
-		case Endianness::LittleSwapped:
-			*p = swap32(htole32(v));
-			break;
-		default:
-			throw invalid_argument("Bad endianness");
+	return max(len / align, (size_t)1) * align;
+}
+
+void I2CTarget::read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < count; ++i)
+		total += sizes[i];
+
+	vector<uint8_t> buf(total);
+	vector<Read> reads;
+	reads.reserve(count);
+
+	uint8_t* p = buf.data();
+	size_t first = 0;
+
+	while (first < count) {
+		const size_t max_len = m_burst_len ? burst_chunk(1) : 0;
+
+		// Split the rest into runs of consecutive registers
+		reads.clear();
+
+		for (size_t i = first; i < count; ) {
+			Read rd { addrs[i], p, sizes[i], i + 1 };
+
+			while (rd.end < count && addrs[rd.end] == addrs[rd.end - 1] + sizes[rd.end - 1] &&
+			       rd.len + sizes[rd.end] <= max_len)
+				rd.len += sizes[rd.end++];
+
+			reads.push_back(rd);
+			p += rd.len;
+			i = rd.end;
 		}
 
-		break;
-	}
-	case 8: {
-		uint64_t v = (uint64_t)value;
-		uint64_t* p = (uint64_t*)buf;
-
-		switch (endianness) {
-		case Endianness::Big:
-			*p = htobe64(v);
-			break;
-		case Endianness::Little:
-			*p = htole64(v);
-			break;
-		case Endianness::BigSwapped:
-			*p = swap64(htobe64(v));
-			break;
-		case Endianness::LittleSwapped:
-			*p = swap64(htole64(v));
-			break;
-		default:
-			throw invalid_argument("Bad endianness");
+		const size_t done = read_packed(reads.data(), reads.size());
+
+		for (size_t j = 0; j < done; ++j) {
+			const Read& rd = reads[j];
+			uint8_t* v = rd.buf;
+
+			for (; first < rd.end; v += sizes[first], ++first)
+				values[first] = device_to_host(v, sizes[first], m_data_endianness);
 		}
 
-		break;
-	}
-	default:
-		abort();
+		if (done < reads.size())
+			p = reads[done].buf;
 	}
 }
 
-uint64_t I2CTarget::read(uint64_t addr, unsigned numbytes) const
+void I2CTarget::read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
 {
-	uint8_t addr_buf[8] { };
-	uint8_t data_buf[8] { };
+	uint8_t* p = (uint8_t*)buf;
+	const size_t len = count * numbytes;
+	vector<Read> reads;
 
-	host_to_device(addr, m_address_bytes, addr_buf, m_address_endianness);
+	for (size_t offset = 0; offset < len; ) {
+		const size_t chunk = m_burst_len ? burst_chunk(numbytes) : numbytes;
 
-	struct i2c_msg msgs[2] { };
+		reads.clear();
 
-	msgs[0].addr = m_i2c_addr;
-	msgs[0].flags = 0;
-	msgs[0].len = m_address_bytes;
-	msgs[0].buf = addr_buf;
+		for (size_t o = offset; o < len; o += chunk)
+			reads.push_back({ addr + o, p + o, min(len - o, chunk), 0 });
 
-	msgs[1].addr = m_i2c_addr;
-	msgs[1].flags = I2C_M_RD;
-	msgs[1].len = numbytes;
-	msgs[1].buf = data_buf;
+		const size_t done = read_packed(reads.data(), reads.size());
 
-	struct i2c_rdwr_ioctl_data data;
-	data.msgs = msgs;
-	data.nmsgs = 2;
-
-	int r = ioctl(m_fd, I2C_RDWR, &data);
-	ERR_ON_ERRNO(r < 0, "i2c transfer failed");
+		offset = done < reads.size() ? reads[done].buf - p : len;
+	}
 
-	return device_to_host(data_buf, numbytes, m_data_endianness);
+	convert_byte_order(buf, buf, count, numbytes, m_data_endianness);
 }
 
 void I2CTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
@@ -224,12 +234,114 @@ void I2CTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
 	msgs[1].len = numbytes;
 	msgs[1].buf = data_buf;
 
+	int r = transfer(msgs, 2);
+	ERR_ON_ERRNO(r < 0, "i2c transfer failed");
+}
+
+// Like write() for each register, but with as few ioctls as possible
+void I2CTarget::write_packed(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+{
+	uint8_t addr_bufs[I2C_RDWR_IOCTL_MAX_MSGS / 2][8];
+	struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+
+	vector<uint8_t> data(count * numbytes);
+	convert_byte_order(data.data(), buf, count, numbytes, m_data_endianness);
+
+	size_t first = 0;
+
+	while (first < count) {
+		const size_t n = min(count - first, (size_t)max(m_max_msgs / 2, 1u));
+
+		for (size_t i = 0; i < n; ++i) {
+			struct i2c_msg* m = &msgs[i * 2];
+
+			host_to_device(addr + (first + i) * numbytes, m_address_bytes, addr_bufs[i],
+				       m_address_endianness);
+
+			m[0].addr = m_i2c_addr;
+			m[0].flags = 0;
+			m[0].len = m_address_bytes;
+			m[0].buf = addr_bufs[i];
+
+			m[1].addr = m_i2c_addr;
+			m[1].flags = 0;
+			m[1].len = numbytes;
+			m[1].buf = &data[(first + i) * numbytes];
+		}
+
+		int r = transfer(msgs, n * 2);
+
+		// Rejected before anything was written, see read_packed()
+		if (r < 0 && errno == EOPNOTSUPP && n > 1) {
+			m_max_msgs = n;
+			continue;
+		}
+
+		ERR_ON_ERRNO(r < 0, "i2c transfer failed");
+
+		first += n;
+	}
+}
+
+void I2CTarget::page_write(uint8_t* buf, size_t len)
+{
+	struct i2c_msg msg { };
+
+	msg.addr = m_i2c_addr;
+	msg.flags = 0;
+	msg.len = len;
+	msg.buf = buf;
+
 	struct i2c_rdwr_ioctl_data data;
-	data.msgs = msgs;
-	data.nmsgs = 2;
+	data.msgs = &msg;
+	data.nmsgs = 1;
 
-	int r = ioctl(m_fd, I2C_RDWR, &data);
-	ERR_ON_ERRNO(r < 0, "i2c transfer failed");
+	// Devices like EEPROMs do not acknowledge their address while they
+	// are busy writing the previous page
+	for (unsigned retry = 0; ; ++retry) {
+		int r = ioctl(m_fd, I2C_RDWR, &data);
+		if (r >= 0)
+			return;
+
+		ERR_ON_ERRNO((errno != ENXIO && errno != EREMOTEIO) || retry == page_write_retries,
+			     "i2c page write failed");
+
+		usleep(page_write_retry_us);
+	}
+}
+
+void I2CTarget::write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+{
+	if (!m_page_size) {
+		write_packed(addr, numbytes, count, buf);
+		return;
+	}
+
+	ERR_ON(m_page_size % numbytes || addr % numbytes,
+	       "i2c page writes need the page size and address aligned to the access size");
+
+	const uint8_t* src = (const uint8_t*)buf;
+	const uint64_t end = addr + (uint64_t)count * numbytes;
+
+	// Room for the address followed by the data, all in one message
+	vector<uint8_t> msg_buf(min(m_address_bytes + (size_t)m_page_size, i2c_max_msg_len));
+	const size_t max_len = (msg_buf.size() - m_address_bytes) / numbytes * numbytes;
+
+	while (addr < end) {
+		// A page write must not cross a page boundary, the device would
+		// wrap around to the start of the page
+		uint64_t len = min(end - addr, m_page_size - addr % m_page_size);
+		len = min(len, (uint64_t)max_len);
+
+		host_to_device(addr, m_address_bytes, msg_buf.data(), m_address_endianness);
+		convert_byte_order(&msg_buf[m_address_bytes], src, len / numbytes, numbytes,
+				   m_data_endianness);
+
+		page_write(msg_buf.data(), m_address_bytes + len);
+
+		addr += len;
+		src += len;
+	}
 }
 
 uint32_t I2CTarget::read32(uint64_t addr) const
@@ -4,6 +4,8 @@
 #include "itarget.h"
 #include "helpers.h"
 
+struct i2c_msg;
+
 class I2CTarget : public ITarget
 {
 public:
@@ -14,9 +16,31 @@ public:
 	uint64_t read(uint64_t addr, unsigned numbytes) const;
 	void write(uint64_t addr, unsigned numbytes, uint64_t value);
 
+	// Batches are read with as few ioctls as possible, up to 21 registers
+	// per ioctl. With burst reads enabled, see set_burst_len(),
+	// consecutive registers are read with one transfer.
+	void read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const;
+	void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const;
+
+	// Writes 'count' registers with page writes of up to the page size,
+	// see set_page_size(), or without a page size with up to 21 registers
+	// per ioctl
+	void write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf);
+	bool batches_reads() const { return true; }
+
 	uint32_t read32(uint64_t addr) const;
 	void write32(uint64_t addr, uint32_t value);
 
+	// Page size for multi-register writes, e.g. an EEPROM's write page.
+	// 0, the default, writes one register per transfer.
+	void set_page_size(unsigned page_size) { m_page_size = page_size; }
+
+	// Maximum bytes per burst read, for devices that increment their
+	// register pointer on reads. 0, the default, reads one register per
+	// transfer. If the adapter cannot do transfers this long, the length
+	// is halved until it can.
+	void set_burst_len(unsigned burst_len) { m_burst_len = burst_len; }
+
 	void map(uint64_t offset, uint64_t length) { }
 	void unmap() { }
 
@@ -27,4 +51,18 @@ private:
 	uint8_t m_address_bytes;
 	Endianness m_address_endianness;
 	Endianness m_data_endianness;
+
+	unsigned m_page_size;
+	mutable unsigned m_burst_len;
+
+	// Messages per I2C_RDWR ioctl, lowered if the adapter cannot do that many
+	mutable unsigned m_max_msgs;
+
+	struct Read;
+
+	int transfer(struct i2c_msg* msgs, size_t nmsgs) const;
+	size_t read_packed(const Read* reads, size_t count) const;
+	void write_packed(uint64_t addr, unsigned numbytes, size_t count, const void* buf);
+	size_t burst_chunk(unsigned align) const;
+	void page_write(uint8_t* buf, size_t len);
 };
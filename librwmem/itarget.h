@@ -1,6 +1,7 @@
 #pragma once
 
 #include "helpers.h"
+#include "byteorder.h"
 
 class ITarget
 {
@@ -10,6 +11,47 @@ public:
 	virtual uint64_t read(uint64_t addr, unsigned numbytes) const = 0;
 	virtual void write(uint64_t addr, unsigned numbytes, uint64_t value) = 0;
 
+	// Read 'count' registers. Targets can override this to transfer the whole batch at once.
+	virtual void read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const
+	{
+		for (size_t i = 0; i < count; ++i)
+			values[i] = read(addrs[i], sizes[i]);
+	}
+
+	// Read 'count' consecutive registers of 'numbytes' bytes starting at
+	// 'addr' into 'buf', as host order values.
+	virtual void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
+	{
+		uint8_t* p = (uint8_t*)buf;
+
+		for (size_t i = 0; i < count; ++i, p += numbytes)
+			put_host(p, read(addr + i * numbytes, numbytes), numbytes);
+	}
+
+	// Write 'count' consecutive registers from host order values in 'buf'
+	virtual void write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+	{
+		const uint8_t* p = (const uint8_t*)buf;
+
+		for (size_t i = 0; i < count; ++i, p += numbytes)
+			write(addr + i * numbytes, numbytes, get_host(p, numbytes));
+	}
+
+	// Replace the bits in 'mask' with those of 'value', returning the old
+	// value. Atomic if atomic_updates(), else a plain read-modify-write.
+	virtual uint64_t update_bits(uint64_t addr, unsigned numbytes, uint64_t mask, uint64_t value)
+	{
+		uint64_t old = read(addr, numbytes);
+		write(addr, numbytes, (old & ~mask) | (value & mask));
+		return old;
+	}
+
+	virtual bool atomic_updates() const { return false; }
+
+	// Whether read_batch() and read_block() are cheaper than the reads one
+	// by one, so that reading registers ahead of their use pays off
+	virtual bool batches_reads() const { return false; }
+
 	virtual uint32_t read32(uint64_t addr) const = 0;
 	virtual void write32(uint64_t addr, uint32_t value) = 0;
 
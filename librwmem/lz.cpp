@@ -0,0 +1,202 @@
+#include "lz.h"
+
+#include <string.h>
+
+static const unsigned hash_bits = 12;
+static const size_t min_match = 4;
+static const size_t max_offset = 65535;
+
+// The format requires the last 5 bytes to be literals, and the last match
+// to start at least 12 bytes before the end
+static const size_t last_literals = 5;
+static const size_t match_find_limit = 12;
+
+static inline uint32_t read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+static uint8_t* put_length(uint8_t* op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+
+	*op++ = len;
+
+	return op;
+}
+
+// Write a sequence of literals and an optional match. Returns NULL if out of space.
+static uint8_t* put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* lit, size_t lit_len,
+			     size_t offset, size_t match_len)
+{
+	const size_t ml = match_len ? match_len - min_match : 0;
+
+	if ((size_t)(oend - op) < 1 + lit_len + lit_len / 255 + 1 + 2 + ml / 255 + 1)
+		return nullptr;
+
+	uint8_t* token = op++;
+
+	*token = (lit_len < 15 ? lit_len : 15) << 4;
+
+	if (lit_len >= 15)
+		op = put_length(op, lit_len - 15);
+
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	if (!match_len)
+		return op;
+
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+
+	*token |= ml < 15 ? ml : 15;
+
+	if (ml >= 15)
+		op = put_length(op, ml - 15);
+
+	return op;
+}
+
+size_t lz_compress_bound(size_t len)
+{
+	return len + len / 255 + 16;
+}
+
+size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_cap)
+{
+	uint8_t* op = dst;
+	uint8_t* const oend = dst + dst_cap;
+
+	size_t anchor = 0;
+
+	if (len > match_find_limit) {
+		uint32_t table[1 << hash_bits];
+		memset(table, 0, sizeof(table));
+
+		const size_t ilimit = len - match_find_limit;
+		const size_t mlimit = len - last_literals;
+
+		size_t ip = 1;
+		unsigned misses = 0;
+
+		while (ip < ilimit) {
+			const uint32_t seq = read32(src + ip);
+			const uint32_t h = hash4(seq);
+
+			size_t ref = table[h];
+			table[h] = ip;
+
+			if (ip - ref > max_offset || read32(src + ref) != seq) {
+				// Skip faster over incompressible data
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+
+			misses = 0;
+
+			while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+				ip--;
+				ref--;
+			}
+
+			size_t mlen = min_match;
+
+			while (ip + mlen < mlimit && src[ip + mlen] == src[ref + mlen])
+				mlen++;
+
+			op = put_sequence(op, oend, src + anchor, ip - anchor, ip - ref, mlen);
+			if (!op)
+				return 0;
+
+			ip += mlen;
+			anchor = ip;
+		}
+	}
+
+	op = put_sequence(op, oend, src + anchor, len - anchor, 0, 0);
+	if (!op)
+		return 0;
+
+	return op - dst;
+}
+
+static bool get_length(const uint8_t*& ip, const uint8_t* iend, size_t* len)
+{
+	uint8_t b;
+
+	do {
+		if (ip == iend)
+			return false;
+
+		b = *ip++;
+		*len += b;
+	} while (b == 255);
+
+	return true;
+}
+
+bool lz_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	const uint8_t* ip = src;
+	const uint8_t* const iend = src + len;
+	uint8_t* op = dst;
+	uint8_t* const oend = dst + dst_len;
+
+	while (ip < iend) {
+		const uint8_t token = *ip++;
+
+		size_t lit_len = token >> 4;
+
+		if (lit_len == 15 && !get_length(ip, iend, &lit_len))
+			return false;
+
+		if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len)
+			return false;
+
+		memcpy(op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+
+		// The last sequence has only literals
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return false;
+
+		size_t match_len = token & 0xf;
+
+		if (match_len == 15 && !get_length(ip, iend, &match_len))
+			return false;
+
+		match_len += min_match;
+
+		if ((size_t)(oend - op) < match_len)
+			return false;
+
+		// The match may overlap the output, so copy byte by byte
+		const uint8_t* m = op - offset;
+
+		for (size_t i = 0; i < match_len; ++i)
+			op[i] = m[i];
+
+		op += match_len;
+	}
+
+	return op == oend;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A fast LZ77 compressor producing the LZ4 block format, for blocks of up to
+ * 64 KiB and more. It has no dictionary or framing; the caller stores the
+ * compressed and uncompressed sizes.
+ */
+
+// Worst case compressed size of 'len' bytes
+size_t lz_compress_bound(size_t len);
+
+// Returns the compressed size, or 0 if it did not fit in dst_cap bytes
+size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_cap);
+
+// Returns false if the data is corrupt or does not decompress to exactly dst_len bytes
+bool lz_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len);
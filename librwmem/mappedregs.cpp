@@ -11,7 +11,8 @@ MappedRegisterBlock::MappedRegisterBlock(const string& mapfile, const string& re
 	if (!m_rbd)
 		throw runtime_error("register block not found");
 
-	m_map = make_unique<MMapTarget>(mapfile, Endianness::Default, m_rbd->offset(), m_rbd->size());
+	m_map = make_shared<MMapTarget>(mapfile, Endianness::Default, m_rbd->offset(), m_rbd->size());
+	m_base = m_rbd->offset();
 }
 
 MappedRegisterBlock::MappedRegisterBlock(const string& mapfile, uint64_t offset, const string& regfile, const string& blockname)
@@ -22,13 +23,28 @@ MappedRegisterBlock::MappedRegisterBlock(const string& mapfile, uint64_t offset,
 	if (!m_rbd)
 		throw runtime_error("register block not found");
 
-	m_map = make_unique<MMapTarget>(mapfile, Endianness::Default, offset, m_rbd->size());
+	m_map = make_shared<MMapTarget>(mapfile, Endianness::Default, offset, m_rbd->size());
+	m_base = offset;
 }
 
 MappedRegisterBlock::MappedRegisterBlock(const string& mapfile, uint64_t offset, uint64_t length)
 	: m_rf(nullptr), m_rbd(nullptr)
 {
-	m_map = make_unique<MMapTarget>(mapfile, Endianness::Default, offset, length);
+	m_map = make_shared<MMapTarget>(mapfile, Endianness::Default, offset, length);
+	m_base = offset;
+}
+
+MappedRegisterBlock::MappedRegisterBlock(shared_ptr<ITarget> target, const string& regfile, const string& blockname)
+	: m_map(target)
+{
+	m_rf = make_unique<RegisterFile>(regfile);
+
+	m_rbd = m_rf->data()->find_block(blockname);
+	if (!m_rbd)
+		throw runtime_error("register block not found");
+
+	m_base = m_rbd->offset();
+	m_map->map(m_base, m_rbd->size());
 }
 
 uint64_t MappedRegisterBlock::read(const string& regname) const
@@ -40,7 +56,7 @@ uint64_t MappedRegisterBlock::read(const string& regname) const
 	if (!rd)
 		throw runtime_error("register not found");
 
-	return m_map->read(rd->offset(), rd->size());
+	return m_map->read(m_base + rd->offset(), rd->size());
 }
 
 RegisterValue MappedRegisterBlock::read_value(const std::string& regname) const
@@ -52,14 +68,14 @@ RegisterValue MappedRegisterBlock::read_value(const std::string& regname) const
 	if (!rd)
 		throw runtime_error("register not found");
 
-	uint64_t v = m_map->read(rd->offset(), rd->size());
+	uint64_t v = m_map->read(m_base + rd->offset(), rd->size());
 
 	return RegisterValue(this, rd, v);
 }
 
 uint32_t MappedRegisterBlock::read32(uint64_t offset) const
 {
-	return m_map->read32(offset);
+	return m_map->read32(m_base + offset);
 }
 
 MappedRegister MappedRegisterBlock::find_register(const string& regname)
@@ -92,7 +108,7 @@ MappedRegister::MappedRegister(MappedRegisterBlock* mrb, uint64_t offset, uint32
 
 uint64_t MappedRegister::read() const
 {
-	return m_mrb->m_map->read(m_offset, m_size);
+	return m_mrb->m_map->read(m_mrb->m_base + m_offset, m_size);
 }
 
 RegisterValue MappedRegister::read_value() const
@@ -102,11 +118,47 @@ RegisterValue MappedRegister::read_value() const
 
 void MappedRegister::write(uint64_t value)
 {
-	m_mrb->m_map->write(m_offset, m_size, value);
+	m_mrb->m_map->write(m_mrb->m_base + m_offset, m_size, value);
+}
+
+uint64_t MappedRegister::update_field(const string& fieldname, uint64_t value)
+{
+	if (!m_mrb->m_rf || !m_rd)
+		throw runtime_error("no register file");
+
+	const FieldData* fd = m_rd->find_field(m_mrb->m_rf->data(), fieldname);
+	if (!fd)
+		throw runtime_error("field not found");
+
+	return update_field(fd->high(), fd->low(), value);
+}
+
+uint64_t MappedRegister::update_field(uint8_t high, uint8_t low, uint64_t value)
+{
+	return m_mrb->m_map->update_bits(m_mrb->m_base + m_offset, m_size,
+					 GENMASK(high, low), value << low);
+}
+
+WaitResult MappedRegister::wait(const string& fieldname, uint64_t value, uint64_t timeout_ns, bool negate) const
+{
+	if (!m_mrb->m_rf || !m_rd)
+		throw runtime_error("no register file");
+
+	const FieldData* fd = m_rd->find_field(m_mrb->m_rf->data(), fieldname);
+	if (!fd)
+		throw runtime_error("field not found");
+
+	return wait(fd->high(), fd->low(), value, timeout_ns, negate);
+}
+
+WaitResult MappedRegister::wait(uint8_t high, uint8_t low, uint64_t value, uint64_t timeout_ns, bool negate) const
+{
+	return wait_for_value(m_mrb->m_map.get(), m_mrb->m_base + m_offset, m_size,
+			      GENMASK(high, low), value << low, negate, timeout_ns);
 }
 
 RegisterValue::RegisterValue(const MappedRegisterBlock* mrb, const RegisterData* rd, uint64_t value)
-	:m_mrb(mrb), m_rd(rd), m_value(value)
+	:m_mrb(mrb), m_rd(rd), m_value(value), m_changed(0)
 {
 
 }
@@ -148,9 +200,16 @@ void RegisterValue::set_field_value(uint8_t high, uint8_t low, uint64_t value)
 	uint64_t mask = GENMASK(high, low);
 
 	m_value = (m_value & ~mask) | ((value << low) & mask);
+	m_changed |= mask;
 }
 
 void RegisterValue::write()
 {
-	m_mrb->m_map->write(m_rd->offset(), m_rd->size(), m_value);
+	ITarget* map = m_mrb->m_map.get();
+	const uint64_t addr = m_mrb->m_base + m_rd->offset();
+
+	if (map->atomic_updates())
+		map->update_bits(addr, m_rd->size(), m_changed, m_value);
+	else
+		map->write(addr, m_rd->size(), m_value);
 }
@@ -4,6 +4,7 @@
 
 #include "regs.h"
 #include "mmaptarget.h"
+#include "wait.h"
 
 class MappedRegister;
 class RegisterValue;
@@ -16,6 +17,7 @@ public:
 	MappedRegisterBlock(const std::string& mapfile, const std::string& regfile, const std::string& blockname);
 	MappedRegisterBlock(const std::string& mapfile, uint64_t offset, const std::string& regfile, const std::string& blockname);
 	MappedRegisterBlock(const std::string& mapfile, uint64_t offset, uint64_t length);
+	MappedRegisterBlock(std::shared_ptr<ITarget> target, const std::string& regfile, const std::string& blockname);
 
 	uint64_t read(const std::string& regname) const;
 	RegisterValue read_value(const std::string& regname) const;
@@ -28,7 +30,8 @@ public:
 private:
 	std::unique_ptr<RegisterFile> m_rf;
 	const RegisterBlockData* m_rbd;
-	std::unique_ptr<ITarget> m_map;
+	std::shared_ptr<ITarget> m_map;
+	uint64_t m_base;
 };
 
 class MappedRegister
@@ -42,6 +45,16 @@ public:
 
 	void write(uint64_t value);
 
+	// Set a field, leaving the rest of the register as it is. Atomic on
+	// shared memory targets, see ITarget::atomic_updates(). Returns the old
+	// register value.
+	uint64_t update_field(const std::string& fieldname, uint64_t value);
+	uint64_t update_field(uint8_t high, uint8_t low, uint64_t value);
+
+	// Wait until the field equals 'value', or differs from it if 'negate' is set
+	WaitResult wait(const std::string& fieldname, uint64_t value, uint64_t timeout_ns, bool negate = false) const;
+	WaitResult wait(uint8_t high, uint8_t low, uint64_t value, uint64_t timeout_ns, bool negate = false) const;
+
 private:
 	MappedRegisterBlock* m_mrb;
 	const RegisterData* m_rd;
@@ -63,10 +76,14 @@ public:
 	operator uint64_t() const { return m_value; }
 	uint64_t value() const { return m_value; }
 
+	// On targets with atomic updates only the fields set since the read
+	// are written, atomically, so concurrent changes to the other fields
+	// are kept. Other targets get the whole value.
 	void write();
 
 private:
 	const MappedRegisterBlock* m_mrb;
 	const RegisterData* m_rd;
 	uint64_t m_value;
+	uint64_t m_changed;
 };
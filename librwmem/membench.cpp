@@ -0,0 +1,228 @@
+#include "membench.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <string.h>
+#include <time.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+typedef uint64_t vec128 __attribute__((vector_size(16)));
+typedef uint64_t vec256 __attribute__((vector_size(32)));
+
+// Pointer chase nodes are one per cache line
+static const size_t chase_stride = 64;
+
+static volatile uint8_t s_sink;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Keep the compiler from dropping the loads
+template<typename T>
+static void consume(const T& v)
+{
+	uint8_t buf[sizeof(T)];
+	memcpy(buf, &v, sizeof(T));
+	s_sink = s_sink ^ buf[0];
+}
+
+template<typename T>
+static void bench_read(uint8_t* p, size_t len)
+{
+	const volatile T* s = (const volatile T*)p;
+	const size_t n = len / sizeof(T);
+	T acc {};
+
+	for (size_t i = 0; i < n; ++i)
+		acc ^= s[i];
+
+	consume(acc);
+}
+
+template<typename T>
+static void bench_write(uint8_t* p, size_t len)
+{
+	volatile T* d = (volatile T*)p;
+	const size_t n = len / sizeof(T);
+	T v;
+
+	memset(&v, 0x5a, sizeof(T));
+
+	for (size_t i = 0; i < n; ++i)
+		d[i] = v;
+}
+
+// Copy the first half of the range to the second half
+template<typename T>
+static void bench_copy(uint8_t* p, size_t len)
+{
+	const volatile T* s = (const volatile T*)p;
+	volatile T* d = (volatile T*)(p + len / 2);
+	const size_t n = len / 2 / sizeof(T);
+
+	for (size_t i = 0; i < n; ++i)
+		d[i] = s[i];
+}
+
+struct MemBenchKernels
+{
+	unsigned width;
+	void (*read)(uint8_t* p, size_t len);
+	void (*write)(uint8_t* p, size_t len);
+	void (*copy)(uint8_t* p, size_t len);
+};
+
+static const MemBenchKernels kernels[] = {
+	{ 8, bench_read<uint8_t>, bench_write<uint8_t>, bench_copy<uint8_t> },
+	{ 16, bench_read<uint16_t>, bench_write<uint16_t>, bench_copy<uint16_t> },
+	{ 32, bench_read<uint32_t>, bench_write<uint32_t>, bench_copy<uint32_t> },
+	{ 64, bench_read<uint64_t>, bench_write<uint64_t>, bench_copy<uint64_t> },
+	{ 128, bench_read<vec128>, bench_write<vec128>, bench_copy<vec128> },
+	{ 256, bench_read<vec256>, bench_write<vec256>, bench_copy<vec256> },
+};
+
+// Link the cache lines of the range into a single cycle in random order, so
+// that neither the prefetcher nor the page locality helps
+static void chase_setup(uint8_t* p, size_t num_nodes)
+{
+	vector<size_t> order(num_nodes);
+	for (size_t i = 0; i < num_nodes; ++i)
+		order[i] = i;
+
+	mt19937_64 rng(num_nodes);
+	shuffle(order.begin() + 1, order.end(), rng);
+
+	for (size_t i = 0; i < num_nodes; ++i) {
+		uint8_t* node = p + order[i] * chase_stride;
+		uint8_t* next = p + order[(i + 1) % num_nodes] * chase_stride;
+		*(uint8_t* volatile*)node = next;
+	}
+}
+
+static void chase(uint8_t* p, size_t steps)
+{
+	uint8_t* cur = p;
+
+	for (size_t i = 0; i < steps; ++i)
+		cur = *(uint8_t* volatile*)cur;
+
+	consume(cur);
+}
+
+template<typename F>
+static uint64_t time_best(F f, uint64_t min_time_ns)
+{
+	uint64_t best = ~0ULL;
+	uint64_t total = 0;
+
+	do {
+		uint64_t t0 = now_ns();
+		f();
+		uint64_t t1 = now_ns();
+
+		best = min(best, t1 - t0);
+		total += t1 - t0;
+	} while (total < min_time_ns);
+
+	return max(best, (uint64_t)1);
+}
+
+const char* membench_test_name(MemBenchTest test)
+{
+	switch (test) {
+	case MemBenchTest::Read:
+		return "read";
+	case MemBenchTest::Write:
+		return "write";
+	case MemBenchTest::Copy:
+		return "copy";
+	case MemBenchTest::Latency:
+		return "latency";
+	}
+
+	FAIL("bad benchmark test");
+}
+
+MemBenchTest membench_parse_test(const string& name)
+{
+	for (MemBenchTest t : { MemBenchTest::Read, MemBenchTest::Write, MemBenchTest::Copy, MemBenchTest::Latency })
+		if (name == membench_test_name(t))
+			return t;
+
+	throw runtime_error("unknown benchmark test '" + name + "'");
+}
+
+vector<MemBenchResult> membench(MMapTarget* target, uint64_t addr, uint64_t length,
+				const vector<MemBenchTest>& tests, uint64_t min_time_ns)
+{
+	target->map(addr, length);
+
+	// Align the start to a cache line, and the length to the widest access
+	const uint64_t start = (addr + chase_stride - 1) & ~(chase_stride - 1);
+	const uint64_t end = addr + length;
+
+	if (end < start + 2 * chase_stride)
+		throw runtime_error("benchmark range too small");
+
+	const size_t len = (end - start) & ~(uint64_t)(chase_stride - 1);
+	uint8_t* p = (uint8_t*)target->mapped_ptr(start, len);
+
+	// All but the read test write to the range
+	if (any_of(tests.begin(), tests.end(), [](MemBenchTest t) { return t != MemBenchTest::Read; }))
+		target->mark_dirty(start, len);
+
+	vector<MemBenchResult> results;
+
+	for (MemBenchTest test : tests) {
+		if (test == MemBenchTest::Latency) {
+			const size_t num_nodes = len / chase_stride;
+
+			chase_setup(p, num_nodes);
+
+			// warm up
+			chase(p, num_nodes);
+
+			uint64_t ns = time_best([p, num_nodes]() { chase(p, num_nodes); }, min_time_ns);
+
+			results.push_back(MemBenchResult { test, (unsigned)sizeof(void*) * 8, len, num_nodes, ns });
+			continue;
+		}
+
+		for (const MemBenchKernels& k : kernels) {
+			void (*f)(uint8_t*, size_t);
+			size_t bytes = len;
+
+			switch (test) {
+			case MemBenchTest::Read:
+				f = k.read;
+				break;
+			case MemBenchTest::Write:
+				f = k.write;
+				break;
+			case MemBenchTest::Copy:
+				f = k.copy;
+				bytes = len / 2;
+				break;
+			default:
+				FAIL("bad benchmark test");
+			}
+
+			// warm up
+			f(p, len);
+
+			uint64_t ns = time_best([f, p, len]() { f(p, len); }, min_time_ns);
+
+			results.push_back(MemBenchResult { test, k.width, bytes, bytes / (k.width / 8), ns });
+		}
+	}
+
+	return results;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mmaptarget.h"
+
+enum class MemBenchTest
+{
+	Read,
+	Write,
+	Copy,
+	Latency,
+};
+
+struct MemBenchResult
+{
+	MemBenchTest test;
+	unsigned width;		// access width in bits
+	uint64_t bytes;		// bytes accessed per pass
+	uint64_t accesses;	// accesses per pass
+	uint64_t ns;		// duration of the fastest pass
+};
+
+const char* membench_test_name(MemBenchTest test);
+MemBenchTest membench_parse_test(const std::string& name);
+
+/*
+ * Benchmark the mapped range [addr, addr + length) of the target. Read, write
+ * and copy are measured for 8 to 64 bit accesses and for 128 and 256 bit
+ * vector accesses, latency with a pointer chase over randomly ordered cache
+ * lines. Each test is repeated for at least min_time_ns, and the fastest pass
+ * is reported.
+ *
+ * Write, copy and latency tests overwrite the range.
+ */
+std::vector<MemBenchResult> membench(MMapTarget* target, uint64_t addr, uint64_t length,
+				     const std::vector<MemBenchTest>& tests, uint64_t min_time_ns);
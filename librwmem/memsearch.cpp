@@ -0,0 +1,141 @@
+#include "memsearch.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+
+#include "helpers.h"
+#include "parallelrange.h"
+
+using namespace std;
+
+// The range is handed out to the threads in chunks of this many bytes
+static const uint64_t chunk_size = 1024 * 1024;
+
+// Values compared per block before looking for the exact positions
+static const size_t block_len = 64;
+
+typedef void (*SearchFunc)(const uint8_t* p, size_t npos, uint64_t value, uint64_t mask,
+			   vector<uint64_t>& offsets);
+
+/*
+ * Count the matches in a block with a branch-free loop, which the compiler
+ * vectorizes, and only locate them if there are any.
+ */
+template<typename T, unsigned Stride>
+static void search_chunk(const uint8_t* p, size_t npos, uint64_t value, uint64_t mask,
+			 vector<uint64_t>& offsets)
+{
+	const T v = (T)value;
+	const T m = (T)mask;
+
+	for (size_t b = 0; b < npos; b += block_len) {
+		const size_t n = min(block_len, npos - b);
+		const uint8_t* bp = p + b * Stride;
+
+		unsigned hits = 0;
+
+		for (size_t i = 0; i < n; ++i) {
+			T x;
+			memcpy(&x, bp + i * Stride, sizeof(T));
+			hits += (x & m) == v;
+		}
+
+		if (!hits)
+			continue;
+
+		for (size_t i = 0; i < n; ++i) {
+			T x;
+			memcpy(&x, bp + i * Stride, sizeof(T));
+
+			if ((x & m) == v)
+				offsets.push_back((b + i) * Stride);
+		}
+	}
+}
+
+static SearchFunc search_func(unsigned numbytes, bool aligned)
+{
+	switch (numbytes) {
+	case 1:
+		return search_chunk<uint8_t, 1>;
+	case 2:
+		return aligned ? search_chunk<uint16_t, 2> : search_chunk<uint16_t, 1>;
+	case 4:
+		return aligned ? search_chunk<uint32_t, 4> : search_chunk<uint32_t, 1>;
+	case 8:
+		return aligned ? search_chunk<uint64_t, 8> : search_chunk<uint64_t, 1>;
+	default:
+		throw invalid_argument("bad search size");
+	}
+}
+
+// The value in the device's byte order, as read from memory by the host
+static uint64_t to_memory_order(uint64_t value, unsigned numbytes, Endianness endianness)
+{
+	uint8_t buf[8] { };
+	host_to_device(value, numbytes, buf, endianness);
+
+	uint64_t v = 0;
+	memcpy(&v, buf, numbytes);
+	return v;
+}
+
+uint64_t memsearch(MMapTarget* target, uint64_t addr, uint64_t length,
+		   unsigned numbytes, Endianness endianness, uint64_t value, uint64_t mask,
+		   unsigned align, unsigned num_threads, MemSearchCallback found)
+{
+	if (align != 1 && align != numbytes)
+		throw invalid_argument("bad search alignment");
+
+	SearchFunc func = search_func(numbytes, align == numbytes);
+
+	if (length < numbytes)
+		return 0;
+
+	const uint64_t m = to_memory_order(mask, numbytes, endianness);
+	const uint64_t v = to_memory_order(value, numbytes, endianness) & m;
+
+	target->map(addr, length);
+
+	const uint8_t* base = (const uint8_t*)target->mapped_ptr(addr, length);
+
+	// Values starting in a chunk may extend into the next one
+	const uint64_t end_pos = addr + length - numbytes + 1;
+
+	ParallelRange pr(addr, length, chunk_size, num_threads);
+
+	vector<vector<uint64_t>> found_addrs(pr.num_slots());
+	uint64_t num_found = 0;
+
+	auto work = [&](const RangeChunk& c) {
+		vector<uint64_t>& addrs = found_addrs[c.slot];
+		addrs.clear();
+
+		const uint64_t first = addr + DIV_ROUND_UP(c.addr - addr, align) * align;
+		const uint64_t end = min(c.addr + c.length, end_pos);
+
+		if (first >= end)
+			return;
+
+		func(base + (first - addr), DIV_ROUND_UP(end - first, align), v, m, addrs);
+
+		for (uint64_t& a : addrs)
+			a += first;
+	};
+
+	auto done = [&](const RangeChunk& c) {
+		const vector<uint64_t>& addrs = found_addrs[c.slot];
+
+		if (addrs.empty())
+			return;
+
+		num_found += addrs.size();
+		found(addrs.data(), addrs.size());
+	};
+
+	pr.run(false, work, done);
+
+	return num_found;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <functional>
+
+#include "mmaptarget.h"
+
+// Called with a batch of matching addresses. Batches come from several
+// threads, but calls are serialized.
+typedef std::function<void(const uint64_t* addrs, size_t count)> MemSearchCallback;
+
+/*
+ * Search the mapped range [addr, addr + length) of the target for every
+ * numbytes wide value v, read with the given endianness, for which
+ * (v & mask) == (value & mask). Values are looked for at every 'align' bytes
+ * from addr, where align is 1 or numbytes.
+ *
+ * The range is split into chunks searched by num_threads threads (0 = one
+ * per CPU). Matches are passed to 'found' as each chunk completes, so they
+ * are sorted within a batch, but batches may arrive out of order.
+ *
+ * The memory is read with plain, possibly vectorized, loads, so this is
+ * meant for memory, not registers. Returns the number of matches.
+ */
+uint64_t memsearch(MMapTarget* target, uint64_t addr, uint64_t length,
+		   unsigned numbytes, Endianness endianness, uint64_t value, uint64_t mask,
+		   unsigned align, unsigned num_threads, MemSearchCallback found);
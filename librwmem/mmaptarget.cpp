@@ -1,5 +1,6 @@
 #include "mmaptarget.h"
 
+#include <algorithm>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -8,18 +9,27 @@
 #include <inttypes.h>
 
 #include "helpers.h"
+#include "byteorder.h"
 
 using namespace std;
 
 static const unsigned pagesize = sysconf(_SC_PAGESIZE);
 static const unsigned pagemask = pagesize - 1;
 
-MMapTarget::MMapTarget(const string& filename, Endianness data_endianness)
-	: m_map_base(MAP_FAILED), m_data_endianness(data_endianness)
+MMapTarget::MMapTarget(const string& filename, Endianness data_endianness, bool cached)
+	: m_map_base(MAP_FAILED), m_data_endianness(data_endianness), m_cached(cached),
+	  m_flush_on_unmap(false)
 {
-	m_fd = open(filename.c_str(), O_RDWR | O_SYNC);
+	// O_SYNC makes /dev/mem mappings uncached
+	m_fd = open(filename.c_str(), O_RDWR | (cached ? 0 : O_SYNC));
 
 	ERR_ON_ERRNO(m_fd == -1, "Failed to open file '%s'", filename.c_str());
+
+	struct stat st;
+	int r = fstat(m_fd, &st);
+	ERR_ON_ERRNO(r, "Failed to get map file stat");
+
+	m_regular_file = S_ISREG(st.st_mode);
 }
 
 MMapTarget::MMapTarget(const string &filename, Endianness data_endianness, uint64_t offset, uint64_t length)
@@ -39,7 +49,7 @@ void MMapTarget::map(uint64_t offset, uint64_t length)
 	unmap();
 
 	const off_t mmap_offset = offset & ~pagemask;
-	const size_t mmap_len = (offset + length + pagesize - 1) & ~pagemask;
+	const size_t mmap_len = (offset - mmap_offset + length + pagesize - 1) & ~pagemask;
 
 	//printf("mmap '%s' offset=%#" PRIx64 " length=%#" PRIx64 " mmap_offset=0x%jx mmap_len=0x%zx\n",
 	//       filename.c_str(), offset, length, mmap_offset, mmap_len);
@@ -49,7 +59,7 @@ void MMapTarget::map(uint64_t offset, uint64_t length)
 	ERR_ON_ERRNO(r, "Failed to get map file stat");
 
 	if (S_ISREG(st.st_mode))
-		ERR_ON(st.st_size < mmap_offset + (off_t)mmap_len, "Trying to access file past its end");
+		ERR_ON(st.st_size < (off_t)(offset + length), "Trying to access file past its end");
 
 	m_map_base = mmap(0, mmap_len,
 			  PROT_READ | PROT_WRITE,
@@ -59,6 +69,10 @@ void MMapTarget::map(uint64_t offset, uint64_t length)
 
 	m_map_offset = mmap_offset;
 	m_map_len = mmap_len;
+
+	// msync() is meaningless for device memory
+	if (m_regular_file)
+		vector<atomic<uint64_t>>(DIV_ROUND_UP(mmap_len / pagesize, 64)).swap(m_dirty);
 }
 
 void MMapTarget::unmap()
@@ -66,7 +80,12 @@ void MMapTarget::unmap()
 	if (m_map_base == MAP_FAILED)
 		return;
 
-	if (munmap(m_map_base, pagesize) == -1)
+	if (m_flush_on_unmap)
+		flush();
+
+	vector<atomic<uint64_t>>().swap(m_dirty);
+
+	if (munmap(m_map_base, m_map_len) == -1)
 		ERR_ERRNO("failed to munmap");
 
 	m_map_base = MAP_FAILED;
@@ -108,6 +127,57 @@ void MMapTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
 	}
 }
 
+void MMapTarget::read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const
+{
+	for (size_t i = 0; i < count; ++i)
+		values[i] = MMapTarget::read(addrs[i], sizes[i]);
+}
+
+static inline uint8_t byteorder8(uint8_t v, Endianness endianness)
+{
+	return v;
+}
+
+template<typename T, T (*Conv)(T, Endianness)>
+static T cas_update(void* addr, T mask, T value, Endianness endianness)
+{
+	T* p = (T*)addr;
+
+	const T dev_mask = Conv(mask, endianness);
+	const T dev_value = Conv(value & mask, endianness);
+
+	T old = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(p, &old, (T)((old & ~dev_mask) | dev_value), false,
+					    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		;
+
+	return Conv(old, endianness);
+}
+
+uint64_t MMapTarget::update_bits(uint64_t addr, unsigned numbytes, uint64_t mask, uint64_t value)
+{
+	if (!is_memory() || addr % numbytes)
+		return ITarget::update_bits(addr, numbytes, mask, value);
+
+	void* p = maddr(addr);
+
+	mark_dirty(addr, numbytes);
+
+	switch (numbytes) {
+	case 1:
+		return cas_update<uint8_t, byteorder8>(p, mask, value, m_data_endianness);
+	case 2:
+		return cas_update<uint16_t, byteorder16>(p, mask, value, m_data_endianness);
+	case 4:
+		return cas_update<uint32_t, byteorder32>(p, mask, value, m_data_endianness);
+	case 8:
+		return cas_update<uint64_t, byteorder64>(p, mask, value, m_data_endianness);
+	default:
+		FAIL("Illegal data regsize '%d'", numbytes);
+	}
+}
+
 uint8_t MMapTarget::read8(uint64_t addr) const
 {
 	return *addr8(addr);
@@ -116,54 +186,181 @@ uint8_t MMapTarget::read8(uint64_t addr) const
 void MMapTarget::write8(uint64_t addr, uint8_t value)
 {
 	*addr8(addr) = value;
+	mark_dirty(addr, 1);
 }
 
 uint16_t MMapTarget::read16(uint64_t addr) const
 {
-	if (m_data_endianness == Endianness::Big)
-		return be16toh(*addr16(addr));
-	else
-		return le16toh(*addr16(addr));
+	return byteorder16(*addr16(addr), m_data_endianness);
 }
 
 void MMapTarget::write16(uint64_t addr, uint16_t value)
 {
-	if (m_data_endianness == Endianness::Big)
-		*addr16(addr) = htobe16(value);
-	else
-		*addr16(addr) = htole16(value);
+	*addr16(addr) = byteorder16(value, m_data_endianness);
+	mark_dirty(addr, 2);
 }
 
 uint32_t MMapTarget::read32(uint64_t addr) const
 {
-	if (m_data_endianness == Endianness::Big)
-		return be32toh(*addr32(addr));
-	else
-		return le32toh(*addr32(addr));
+	return byteorder32(*addr32(addr), m_data_endianness);
 }
 
 void MMapTarget::write32(uint64_t addr, uint32_t value)
 {
-	if (m_data_endianness == Endianness::Big)
-		*addr32(addr) = htobe32(value);
-	else
-		*addr32(addr) = htole32(value);
+	*addr32(addr) = byteorder32(value, m_data_endianness);
+	mark_dirty(addr, 4);
 }
 
 uint64_t MMapTarget::read64(uint64_t addr) const
 {
-	if (m_data_endianness == Endianness::Big)
-		return be64toh(*addr64(addr));
-	else
-		return le16toh(*addr64(addr));
+	return byteorder64(*addr64(addr), m_data_endianness);
 }
 
 void MMapTarget::write64(uint64_t addr, uint64_t value)
 {
-	if (m_data_endianness == Endianness::Big)
-		*addr64(addr) = htobe64(value);
-	else
-		*addr64(addr) = htole64(value);
+	*addr64(addr) = byteorder64(value, m_data_endianness);
+	mark_dirty(addr, 8);
+}
+
+template<typename T>
+static void copy_in(T* dst, const volatile T* src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = src[i];
+}
+
+void MMapTarget::read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
+{
+	const void* src = mapped_ptr(addr, (uint64_t)count * numbytes);
+
+	// Keep the accesses at the register width, convert afterwards in bulk
+	switch (numbytes) {
+	case 1:
+		copy_in((uint8_t*)buf, (const volatile uint8_t*)src, count);
+		return;
+	case 2:
+		copy_in((uint16_t*)buf, (const volatile uint16_t*)src, count);
+		break;
+	case 4:
+		copy_in((uint32_t*)buf, (const volatile uint32_t*)src, count);
+		break;
+	case 8:
+		copy_in((uint64_t*)buf, (const volatile uint64_t*)src, count);
+		break;
+	default:
+		FAIL("Illegal data regsize '%d'", numbytes);
+	}
+
+	convert_byte_order(buf, buf, count, numbytes, m_data_endianness);
+}
+
+template<typename T>
+static void copy_out(volatile T* dst, const T* src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = src[i];
+}
+
+void MMapTarget::write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+{
+	uint8_t* dst = (uint8_t*)mapped_ptr(addr, (uint64_t)count * numbytes);
+	const uint8_t* src = (const uint8_t*)buf;
+
+	mark_dirty(addr, (uint64_t)count * numbytes);
+
+	if (numbytes == 1) {
+		copy_out((volatile uint8_t*)dst, src, count);
+		return;
+	}
+
+	// Convert a cache friendly piece at a time, then store at the register width
+	uint64_t tmp[512];
+	const size_t piece = sizeof(tmp) / numbytes;
+
+	for (size_t done = 0; done < count; ) {
+		const size_t n = min(count - done, piece);
+		const size_t offset = done * numbytes;
+
+		convert_byte_order(tmp, src + offset, n, numbytes, m_data_endianness);
+
+		switch (numbytes) {
+		case 2:
+			copy_out((volatile uint16_t*)(dst + offset), (const uint16_t*)tmp, n);
+			break;
+		case 4:
+			copy_out((volatile uint32_t*)(dst + offset), (const uint32_t*)tmp, n);
+			break;
+		case 8:
+			copy_out((volatile uint64_t*)(dst + offset), (const uint64_t*)tmp, n);
+			break;
+		default:
+			FAIL("Illegal data regsize '%d'", numbytes);
+		}
+
+		done += n;
+	}
+}
+
+void MMapTarget::mark_dirty(uint64_t addr, uint64_t length)
+{
+	if (m_dirty.empty() || !length)
+		return;
+
+	const uint64_t first = (addr - m_map_offset) / pagesize;
+	const uint64_t last = (addr + length - 1 - m_map_offset) / pagesize;
+
+	for (uint64_t page = first; page <= last; ++page) {
+		atomic<uint64_t>& word = m_dirty[page / 64];
+		const uint64_t bit = 1ull << (page % 64);
+
+		// Most writes hit a page that is already dirty, so avoid the
+		// locked operation
+		if (!(word.load(memory_order_relaxed) & bit))
+			word.fetch_or(bit, memory_order_relaxed);
+	}
+}
+
+uint64_t MMapTarget::flush()
+{
+	if (m_dirty.empty())
+		return 0;
+
+	const uint64_t num_pages = m_map_len / pagesize;
+	uint64_t synced = 0;
+
+	uint64_t page = 0;
+
+	while (page < num_pages) {
+		if (!(m_dirty[page / 64].load(memory_order_relaxed) & (1ull << (page % 64)))) {
+			page++;
+			continue;
+		}
+
+		const uint64_t start = page;
+
+		while (page < num_pages && (m_dirty[page / 64].load(memory_order_relaxed) & (1ull << (page % 64))))
+			page++;
+
+		const size_t len = (page - start) * pagesize;
+
+		int r = msync((uint8_t*)m_map_base + start * pagesize, len, MS_SYNC);
+		ERR_ON_ERRNO(r, "msync failed");
+
+		synced += len;
+	}
+
+	for (atomic<uint64_t>& word : m_dirty)
+		word.store(0, memory_order_relaxed);
+
+	return synced;
+}
+
+void* MMapTarget::mapped_ptr(uint64_t addr, uint64_t length) const
+{
+	FAIL_IF(addr < m_map_offset, "address below map range");
+	FAIL_IF(addr + length > m_map_offset + m_map_len, "address above map range");
+
+	return (uint8_t*)m_map_base + (addr - m_map_offset);
 }
 
 void* MMapTarget::maddr(uint64_t addr) const
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include "itarget.h"
 
 class MMapTarget : public ITarget
 {
 public:
-	MMapTarget(const std::string& filename, Endianness data_endianness);
+	MMapTarget(const std::string& filename, Endianness data_endianness, bool cached = false);
 	MMapTarget(const std::string& filename, Endianness data_endianness, uint64_t offset, uint64_t length);
 	~MMapTarget();
 
@@ -16,6 +18,16 @@ public:
 	uint64_t read(uint64_t addr, unsigned numbytes) const;
 	void write(uint64_t addr, unsigned numbytes, uint64_t value);
 
+	void read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const;
+	void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const;
+	void write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf);
+
+	// Plain memory is updated with compare-and-swap loops at the access
+	// width, so that concurrent updates of other bits by other processes
+	// or cores are not lost. Unaligned addresses get a read-modify-write.
+	uint64_t update_bits(uint64_t addr, unsigned numbytes, uint64_t mask, uint64_t value);
+	bool atomic_updates() const { return is_memory(); }
+
 	uint8_t read8(uint64_t addr) const;
 	void write8(uint64_t addr, uint8_t value);
 
@@ -28,6 +40,25 @@ public:
 	uint64_t read64(uint64_t addr) const;
 	void write64(uint64_t addr, uint64_t value);
 
+	// Direct access to the mapping, for bulk operations. Writers must
+	// call mark_dirty() for the range they wrote.
+	void* mapped_ptr(uint64_t addr, uint64_t length) const;
+
+	/*
+	 * The pages written in the current mapping of a regular file are
+	 * tracked, thread safely, so that flush() can msync() only the dirty
+	 * ranges, merged into as few calls as possible. Returns the number of
+	 * bytes synced. With flush_on_unmap set, unmap() and so also map() and
+	 * the destructor flush first.
+	 */
+	void mark_dirty(uint64_t addr, uint64_t length);
+	uint64_t flush();
+	void set_flush_on_unmap(bool flush) { m_flush_on_unmap = flush; }
+
+	// True for regular files and cached mappings, which are plain memory
+	// and can be accessed at any width
+	bool is_memory() const { return m_regular_file || m_cached; }
+
 private:
 	int m_fd;
 	void* m_map_base;
@@ -36,6 +67,12 @@ private:
 	uint64_t m_map_len;
 
 	Endianness m_data_endianness;
+	bool m_cached;
+	bool m_regular_file;
+
+	// A bit per page of the mapping, empty if not tracked
+	std::vector<std::atomic<uint64_t>> m_dirty;
+	bool m_flush_on_unmap;
 
 	void* maddr(uint64_t addr) const;
 
@@ -0,0 +1,119 @@
+#include "parallelrange.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+static const unsigned pagesize = sysconf(_SC_PAGESIZE);
+
+ParallelRange::ParallelRange(uint64_t addr, uint64_t length, uint64_t chunk_size, unsigned num_threads)
+	: m_addr(addr), m_length(length), m_chunk_size(chunk_size)
+{
+	if (chunk_size == 0 || chunk_size % pagesize)
+		throw invalid_argument("chunk size not a multiple of page size");
+
+	const uint64_t base = addr - addr % chunk_size;
+
+	m_num_chunks = length ? DIV_ROUND_UP(addr + length - base, chunk_size) : 0;
+
+	if (num_threads == 0)
+		num_threads = max(thread::hardware_concurrency(), 1u);
+
+	m_num_threads = max(min((uint64_t)num_threads, m_num_chunks), (uint64_t)1);
+
+	// Enough for every thread to work on one chunk while another waits to be done
+	m_num_slots = m_num_threads * 2;
+}
+
+RangeChunk ParallelRange::chunk(uint64_t index) const
+{
+	const uint64_t base = m_addr - m_addr % m_chunk_size + index * m_chunk_size;
+	const uint64_t start = max(m_addr, base);
+	const uint64_t end = min(m_addr + m_length, base + m_chunk_size);
+
+	return RangeChunk { index, start, end - start, (unsigned)(index % m_num_slots) };
+}
+
+void ParallelRange::run(bool ordered, ChunkFunc work, ChunkFunc done)
+{
+	mutex lock;
+	condition_variable slot_freed;
+	mutex done_lock;
+
+	uint64_t next = 0;		// next chunk to hand out
+	uint64_t next_done = 0;		// ordered: next chunk to pass to 'done'
+	bool emitting = false;		// ordered: a thread is calling 'done'
+
+	vector<bool> busy(m_num_slots);
+	vector<bool> complete(m_num_slots);
+
+	auto worker = [&]() {
+		unique_lock<mutex> l(lock);
+
+		while (next < m_num_chunks) {
+			const RangeChunk c = chunk(next++);
+
+			slot_freed.wait(l, [&]() { return !busy[c.slot]; });
+			busy[c.slot] = true;
+
+			l.unlock();
+
+			work(c);
+
+			if (!ordered) {
+				{
+					lock_guard<mutex> dl(done_lock);
+					done(c);
+				}
+
+				l.lock();
+				busy[c.slot] = false;
+				slot_freed.notify_all();
+				continue;
+			}
+
+			l.lock();
+			complete[c.slot] = true;
+
+			// Whoever completes the next chunk in order passes on all
+			// the consecutive completed chunks
+			if (emitting)
+				continue;
+
+			emitting = true;
+
+			while (next_done < m_num_chunks && complete[next_done % m_num_slots]) {
+				const RangeChunk d = chunk(next_done);
+
+				l.unlock();
+				done(d);
+				l.lock();
+
+				complete[d.slot] = false;
+				busy[d.slot] = false;
+				next_done++;
+				slot_freed.notify_all();
+			}
+
+			emitting = false;
+		}
+	};
+
+	vector<thread> threads;
+
+	for (unsigned i = 1; i < m_num_threads; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (thread& t : threads)
+		t.join();
+}
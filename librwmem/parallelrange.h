@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+
+struct RangeChunk
+{
+	uint64_t index;
+	uint64_t addr;
+	uint64_t length;
+
+	// Output buffer slot of the chunk, in [0, ParallelRange::num_slots())
+	unsigned slot;
+};
+
+/*
+ * Splits the range [addr, addr + length) into chunks at multiples of
+ * chunk_size, which must be a multiple of the page size, and runs an
+ * operation on them with a pool of threads.
+ *
+ * Each chunk in flight owns an output buffer slot, so that the caller can
+ * keep num_slots() buffers and let 'work' fill the chunk's slot without
+ * locking. 'done' is called for every chunk after its work has finished,
+ * one call at a time, either in address order or as the chunks complete.
+ * A slot is reused only after 'done' has returned for its previous chunk.
+ */
+class ParallelRange
+{
+public:
+	typedef std::function<void(const RangeChunk& chunk)> ChunkFunc;
+
+	// num_threads 0 = one per CPU
+	ParallelRange(uint64_t addr, uint64_t length, uint64_t chunk_size, unsigned num_threads);
+
+	unsigned num_threads() const { return m_num_threads; }
+	unsigned num_slots() const { return m_num_slots; }
+	uint64_t num_chunks() const { return m_num_chunks; }
+
+	void run(bool ordered, ChunkFunc work, ChunkFunc done);
+
+private:
+	uint64_t m_addr;
+	uint64_t m_length;
+	uint64_t m_chunk_size;
+
+	unsigned m_num_threads;
+	unsigned m_num_slots;
+	uint64_t m_num_chunks;
+
+	RangeChunk chunk(uint64_t index) const;
+};
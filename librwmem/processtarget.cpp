@@ -0,0 +1,152 @@
+#include "processtarget.h"
+
+#include <algorithm>
+#include <vector>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/uio.h>
+
+#include "helpers.h"
+#include "byteorder.h"
+
+using namespace std;
+
+// Block reads and writes are done in pieces of this size
+static const size_t block_chunk_size = 1024 * 1024;
+
+ProcessTarget::ProcessTarget(pid_t pid, uint64_t base, Endianness data_endianness)
+	: m_pid(pid), m_base(base), m_data_endianness(data_endianness)
+{
+	// Access rights are only checked on transfers, but fail early if the
+	// process does not exist
+	int r = kill(pid, 0);
+	ERR_ON_ERRNO(r && errno == ESRCH, "Failed to find process %d", pid);
+}
+
+// Move 'len' bytes between 'buf' and the remote iovecs, at most IOV_MAX of them
+void ProcessTarget::transfer(bool write, void* buf, size_t len,
+			     const struct iovec* remote, size_t num_remote) const
+{
+	struct iovec local { buf, len };
+
+	ssize_t r;
+
+	if (write)
+		r = process_vm_writev(m_pid, &local, 1, remote, num_remote, 0);
+	else
+		r = process_vm_readv(m_pid, &local, 1, remote, num_remote, 0);
+
+	ERR_ON_ERRNO(r < 0, "Failed to %s process %d memory at %#" PRIx64,
+		     write ? "write" : "read", m_pid, (uint64_t)(uintptr_t)remote[0].iov_base);
+
+	// A partial transfer stops at the first inaccessible remote page
+	ERR_ON((size_t)r != len, "Failed to %s process %d memory near %#" PRIx64,
+	       write ? "write" : "read", m_pid, (uint64_t)(uintptr_t)remote[0].iov_base + r);
+}
+
+uint64_t ProcessTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	uint8_t buf[8];
+	struct iovec remote { (void*)(uintptr_t)(m_base + addr), numbytes };
+
+	transfer(false, buf, numbytes, &remote, 1);
+
+	return device_to_host(buf, numbytes, m_data_endianness);
+}
+
+void ProcessTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	uint8_t buf[8];
+	struct iovec remote { (void*)(uintptr_t)(m_base + addr), numbytes };
+
+	host_to_device(value, numbytes, buf, m_data_endianness);
+
+	transfer(true, buf, numbytes, &remote, 1);
+}
+
+void ProcessTarget::read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const
+{
+	// The remote data is scattered to the local buffer in order, so one
+	// local buffer takes the registers back to back
+	vector<uint8_t> buf;
+	vector<struct iovec> remote;
+
+	size_t first = 0;
+
+	while (first < count) {
+		buf.clear();
+		remote.clear();
+
+		size_t i = first;
+
+		for (; i < count; ++i) {
+			uint8_t* const rp = (uint8_t*)(uintptr_t)(m_base + addrs[i]);
+
+			if (!remote.empty() && (uint8_t*)remote.back().iov_base + remote.back().iov_len == rp) {
+				remote.back().iov_len += sizes[i];
+			} else {
+				if (remote.size() == IOV_MAX)
+					break;
+
+				remote.push_back(iovec { rp, sizes[i] });
+			}
+
+			buf.resize(buf.size() + sizes[i]);
+		}
+
+		transfer(false, buf.data(), buf.size(), remote.data(), remote.size());
+
+		uint8_t* p = buf.data();
+
+		for (size_t j = first; j < i; ++j) {
+			values[j] = device_to_host(p, sizes[j], m_data_endianness);
+			p += sizes[j];
+		}
+
+		first = i;
+	}
+}
+
+void ProcessTarget::read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const
+{
+	uint8_t* p = (uint8_t*)buf;
+	const size_t len = count * numbytes;
+
+	for (size_t offset = 0; offset < len; offset += block_chunk_size) {
+		const size_t l = min(len - offset, block_chunk_size);
+		struct iovec remote { (void*)(uintptr_t)(m_base + addr + offset), l };
+
+		transfer(false, p + offset, l, &remote, 1);
+	}
+
+	convert_byte_order(buf, buf, count, numbytes, m_data_endianness);
+}
+
+void ProcessTarget::write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf)
+{
+	const uint8_t* src = (const uint8_t*)buf;
+	const size_t len = count * numbytes;
+
+	vector<uint8_t> tmp(min(len, block_chunk_size));
+
+	for (size_t offset = 0; offset < len; offset += tmp.size()) {
+		const size_t l = min(len - offset, tmp.size());
+		struct iovec remote { (void*)(uintptr_t)(m_base + addr + offset), l };
+
+		convert_byte_order(tmp.data(), src + offset, l / numbytes, numbytes, m_data_endianness);
+
+		transfer(true, tmp.data(), l, &remote, 1);
+	}
+}
+
+uint32_t ProcessTarget::read32(uint64_t addr) const
+{
+	return read(addr, 4);
+}
+
+void ProcessTarget::write32(uint64_t addr, uint32_t value)
+{
+	write(addr, 4, value);
+}
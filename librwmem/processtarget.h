@@ -0,0 +1,38 @@
+#pragma once
+
+#include <sys/types.h>
+#include "itarget.h"
+
+/*
+ * A target in the address space of another process, accessed with
+ * process_vm_readv() and process_vm_writev(). Target address 'addr' is
+ * 'base + addr' in the process. Batch and block reads are done with as few
+ * system calls as the iovec limit allows, merging adjacent registers.
+ */
+class ProcessTarget : public ITarget
+{
+public:
+	ProcessTarget(pid_t pid, uint64_t base, Endianness data_endianness);
+
+	void map(uint64_t offset, uint64_t length) { }
+	void unmap() { }
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const;
+	void write(uint64_t addr, unsigned numbytes, uint64_t value);
+
+	void read_batch(const uint64_t* addrs, const unsigned* sizes, uint64_t* values, size_t count) const;
+	void read_block(uint64_t addr, unsigned numbytes, size_t count, void* buf) const;
+	void write_block(uint64_t addr, unsigned numbytes, size_t count, const void* buf);
+	bool batches_reads() const { return true; }
+
+	uint32_t read32(uint64_t addr) const;
+	void write32(uint64_t addr, uint32_t value);
+
+private:
+	pid_t m_pid;
+	uint64_t m_base;
+	Endianness m_data_endianness;
+
+	void transfer(bool write, void* buf, size_t len,
+		      const struct iovec* remote, size_t num_remote) const;
+};
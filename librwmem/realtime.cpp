@@ -0,0 +1,165 @@
+#include "realtime.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+// Stack and heap touched up front, so that the loops do not fault them in
+static const size_t prefault_stack_size = 256 * 1024;
+static const size_t prefault_heap_size = 4 * 1024 * 1024;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+__attribute__((noinline))
+static void prefault_stack()
+{
+	volatile uint8_t buf[prefault_stack_size];
+
+	for (size_t i = 0; i < sizeof(buf); i += 4096)
+		buf[i] = 0;
+}
+
+static void prefault_heap()
+{
+	// Keep freed memory in the heap instead of returning it to the
+	// kernel, and serve large allocations from the locked heap too
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	void* p = malloc(prefault_heap_size);
+	ERR_ON(!p, "Failed to allocate memory");
+
+	memset(p, 0, prefault_heap_size);
+	free(p);
+}
+
+void realtime_setup(const RealtimeConfig& cfg)
+{
+	// Wake up from sleeps on time, not up to the default 50 us later
+	prctl(PR_SET_TIMERSLACK, 1);
+
+	if (cfg.lock_memory) {
+		// MCL_FUTURE also populates all later mappings, like the
+		// target's, as they are made
+		int r = mlockall(MCL_CURRENT | MCL_FUTURE);
+		ERR_ON_ERRNO(r, "Failed to lock memory");
+
+		prefault_stack();
+		prefault_heap();
+	}
+
+	if (cfg.priority) {
+		struct sched_param param { };
+		param.sched_priority = cfg.priority;
+
+		int r = sched_setscheduler(0, SCHED_FIFO, &param);
+		ERR_ON_ERRNO(r, "Failed to set SCHED_FIFO priority %d", cfg.priority);
+	}
+
+	if (cfg.cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cfg.cpu, &set);
+
+		int r = sched_setaffinity(0, sizeof(set), &set);
+		ERR_ON_ERRNO(r, "Failed to pin to CPU %d", cfg.cpu);
+	}
+}
+
+uint64_t sleep_until_ns(uint64_t deadline, uint64_t spin_ns)
+{
+	uint64_t now = now_ns();
+
+	if (deadline > now + spin_ns) {
+		const uint64_t t = deadline - spin_ns;
+
+		struct timespec ts;
+		ts.tv_sec = t / 1000000000;
+		ts.tv_nsec = t % 1000000000;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+			;
+	}
+
+	while ((now = now_ns()) < deadline)
+		;
+
+	return now - deadline;
+}
+
+static unsigned bucket_index(uint64_t v)
+{
+	if (v < 16)
+		return v;
+
+	const unsigned msb = 63 - __builtin_clzll(v);
+
+	return (msb - 3) * 16 + ((v >> (msb - 4)) & 15);
+}
+
+// The smallest value in a bucket
+static uint64_t bucket_value(unsigned idx)
+{
+	if (idx < 16)
+		return idx;
+
+	const unsigned msb = idx / 16 + 3;
+
+	return (uint64_t)(16 + idx % 16) << (msb - 4);
+}
+
+JitterStats::JitterStats()
+	: m_count(0), m_min(~0ULL), m_max(0), m_sum(0), m_buckets()
+{
+}
+
+void JitterStats::add(uint64_t lateness_ns)
+{
+	m_count++;
+	m_min = std::min(m_min, lateness_ns);
+	m_max = std::max(m_max, lateness_ns);
+	m_sum += lateness_ns;
+	m_buckets[bucket_index(lateness_ns)]++;
+}
+
+uint64_t JitterStats::percentile(double p) const
+{
+	if (m_count == 0)
+		return 0;
+
+	const uint64_t rank = std::max<uint64_t>(1, p / 100 * m_count + 0.5);
+	uint64_t n = 0;
+
+	for (unsigned i = 0; i < num_buckets; ++i) {
+		n += m_buckets[i];
+
+		if (n >= rank)
+			return std::min(std::max(bucket_value(i), min()), m_max);
+	}
+
+	return m_max;
+}
+
+void JitterStats::print(FILE* f, const char* what) const
+{
+	fprintf(f, "%s: %" PRIu64 " wakeups, late by min %.1f us, mean %.1f us, "
+		"p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+		what, count(), min() / 1000.0, mean() / 1000.0,
+		percentile(99) / 1000.0, percentile(99.9) / 1000.0, max() / 1000.0);
+}
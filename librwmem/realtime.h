@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Helpers for timing-sensitive loops: locking memory so that no page faults
+ * happen in the loop, real-time scheduling and CPU pinning, and delays that
+ * sleep most of the time and spin the rest for accuracy.
+ */
+
+struct RealtimeConfig
+{
+	bool lock_memory = true;	// mlockall() and prefault the stack and heap
+	int priority = 0;		// SCHED_FIFO priority, 0 = normal scheduling
+	int cpu = -1;			// pin to this CPU, -1 = any
+	uint64_t spin_ns = 50000;	// spin the last part of each delay
+};
+
+// Lock memory for the whole process, and set the scheduling, affinity and
+// timer slack of the calling thread
+void realtime_setup(const RealtimeConfig& cfg);
+
+// Sleep until CLOCK_MONOTONIC time 'deadline' (ns), spinning for the last
+// 'spin_ns'. Returns how late it returned, in ns.
+uint64_t sleep_until_ns(uint64_t deadline, uint64_t spin_ns);
+
+/*
+ * Statistics of wakeup lateness, in constant memory: exact minimum, maximum
+ * and mean, and percentiles from a histogram with 16 buckets per power of
+ * two, i.e. within about 6%.
+ */
+class JitterStats
+{
+public:
+	JitterStats();
+
+	void add(uint64_t lateness_ns);
+
+	uint64_t count() const { return m_count; }
+	uint64_t min() const { return m_count ? m_min : 0; }
+	uint64_t max() const { return m_max; }
+	uint64_t mean() const { return m_count ? m_sum / m_count : 0; }
+	uint64_t percentile(double p) const;
+
+	// One line summary, e.g. for the end of a run
+	void print(FILE* f, const char* what) const;
+
+private:
+	static const unsigned num_buckets = 61 * 16;
+
+	uint64_t m_count;
+	uint64_t m_min;
+	uint64_t m_max;
+	uint64_t m_sum;
+	uint64_t m_buckets[num_buckets];
+};
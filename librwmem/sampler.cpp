@@ -0,0 +1,294 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+static uint64_t align_up(uint64_t v, uint64_t align)
+{
+	return (v + align - 1) & ~(align - 1);
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const uint64_t* ring_addrs(const SampleRingHeader* hdr)
+{
+	return (const uint64_t*)(hdr + 1);
+}
+
+static const uint32_t* ring_sizes(const SampleRingHeader* hdr)
+{
+	return (const uint32_t*)(ring_addrs(hdr) + hdr->num_regs);
+}
+
+static const SampleSlot* ring_slot(const SampleRingHeader* hdr, uint64_t index)
+{
+	uint64_t idx = index & (hdr->num_slots - 1);
+	return (const SampleSlot*)((const uint8_t*)hdr + hdr->slots_offset + idx * hdr->slot_size);
+}
+
+Sampler::Sampler(shared_ptr<ITarget> target, const string& name,
+		 const vector<uint64_t>& addrs, const vector<unsigned>& sizes,
+		 uint32_t num_slots)
+	: m_target(target), m_name(name), m_addrs(addrs), m_sizes(sizes), m_running(false),
+	  m_realtime(false)
+{
+	if (addrs.empty() || addrs.size() != sizes.size())
+		throw invalid_argument("Bad sampler register list");
+
+	// round up to a power of two
+	num_slots = 1u << fls(max(num_slots, 2u) * 2 - 1);
+
+	const uint32_t num_regs = addrs.size();
+	const uint64_t slots_offset = align_up(sizeof(SampleRingHeader) + num_regs * (8 + 4), 64);
+	const uint64_t slot_size = align_up(sizeof(SampleSlot) + num_regs * 8, 64);
+
+	m_len = slots_offset + slot_size * num_slots;
+
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ERR_ON_ERRNO(fd < 0, "Failed to open shm '%s'", name.c_str());
+
+	int r = ftruncate(fd, m_len);
+	ERR_ON_ERRNO(r, "Failed to size shm '%s'", name.c_str());
+
+	void* base = mmap(NULL, m_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	ERR_ON_ERRNO(base == MAP_FAILED, "Failed to mmap shm '%s'", name.c_str());
+
+	close(fd);
+
+	m_hdr = (SampleRingHeader*)base;
+
+	m_hdr->version = RWMEM_SAMPLE_VERSION;
+	m_hdr->num_regs = num_regs;
+	m_hdr->num_slots = num_slots;
+	m_hdr->interval = 0;
+	m_hdr->slot_size = slot_size;
+	m_hdr->slots_offset = slots_offset;
+	m_hdr->head.store(0, memory_order_relaxed);
+
+	copy(addrs.begin(), addrs.end(), (uint64_t*)ring_addrs(m_hdr));
+	copy(sizes.begin(), sizes.end(), (uint32_t*)ring_sizes(m_hdr));
+
+	// The slots are zero filled by ftruncate, i.e. seq 0, no sample
+
+	atomic_thread_fence(memory_order_release);
+	m_hdr->magic = RWMEM_SAMPLE_MAGIC;
+
+	auto range = minmax_element(addrs.begin(), addrs.end());
+	m_target->map(*range.first, *range.second + 8 - *range.first);
+}
+
+Sampler::~Sampler()
+{
+	stop();
+
+	munmap(m_hdr, m_len);
+	shm_unlink(m_name.c_str());
+}
+
+void Sampler::sample()
+{
+	const uint64_t n = m_hdr->head.load(memory_order_relaxed);
+	SampleSlot* slot = const_cast<SampleSlot*>(ring_slot(m_hdr, n));
+
+	slot->seq.store(2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->timestamp = now_ns();
+	m_target->read_batch(m_addrs.data(), m_sizes.data(), slot->values(), m_addrs.size());
+
+	slot->seq.store(2 * n + 2, memory_order_release);
+	m_hdr->head.store(n + 1, memory_order_release);
+}
+
+void Sampler::set_realtime(const RealtimeConfig& cfg)
+{
+	m_realtime = true;
+	m_rt_config = cfg;
+}
+
+void Sampler::loop(uint64_t interval_ns, uint64_t count)
+{
+	int tfd = -1;
+
+	m_jitter = JitterStats();
+
+	if (m_realtime)
+		realtime_setup(m_rt_config);
+
+	uint64_t deadline = now_ns() + interval_ns;
+
+	if (!m_realtime) {
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		ERR_ON_ERRNO(tfd < 0, "Failed to create timerfd");
+
+		struct itimerspec its { };
+		its.it_interval.tv_sec = interval_ns / 1000000000;
+		its.it_interval.tv_nsec = interval_ns % 1000000000;
+
+		its.it_value.tv_sec = deadline / 1000000000;
+		its.it_value.tv_nsec = deadline % 1000000000;
+
+		int r = timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, nullptr);
+		ERR_ON_ERRNO(r, "Failed to set timerfd");
+	}
+
+	sample();
+
+	uint64_t n = 1;
+
+	while (m_running && (count == 0 || n < count)) {
+		if (m_realtime) {
+			m_jitter.add(sleep_until_ns(deadline, m_rt_config.spin_ns));
+
+			// Sample times missed entirely are skipped, as with the timer
+			const uint64_t now = now_ns();
+			deadline += interval_ns;
+
+			if (now >= deadline)
+				deadline += ((now - deadline) / interval_ns + 1) * interval_ns;
+		} else {
+			uint64_t expirations;
+
+			ssize_t l = read(tfd, &expirations, sizeof(expirations));
+			if (l < 0 && errno == EINTR)
+				continue;
+
+			ERR_ON_ERRNO(l != sizeof(expirations), "Failed to read timerfd");
+
+			deadline += (expirations - 1) * interval_ns;
+			m_jitter.add(now_ns() - deadline);
+			deadline += interval_ns;
+		}
+
+		sample();
+		n++;
+	}
+
+	if (tfd >= 0)
+		close(tfd);
+}
+
+void Sampler::start(uint64_t interval_ns)
+{
+	stop();
+
+	m_hdr->interval = interval_ns;
+	m_running = true;
+	m_thread = thread(&Sampler::loop, this, interval_ns, 0);
+}
+
+void Sampler::stop()
+{
+	m_running = false;
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void Sampler::run(uint64_t interval_ns, uint64_t count)
+{
+	m_hdr->interval = interval_ns;
+	m_running = true;
+	loop(interval_ns, count);
+	m_running = false;
+}
+
+SampleReader::SampleReader(const string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	ERR_ON_ERRNO(fd < 0, "Failed to open shm '%s'", name.c_str());
+
+	struct stat st;
+	int r = fstat(fd, &st);
+	ERR_ON_ERRNO(r, "Failed to get shm stat");
+
+	if ((size_t)st.st_size < sizeof(SampleRingHeader))
+		throw runtime_error("Bad sample ring size");
+
+	void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	ERR_ON_ERRNO(base == MAP_FAILED, "Failed to mmap shm '%s'", name.c_str());
+
+	close(fd);
+
+	m_hdr = (const SampleRingHeader*)base;
+	m_len = st.st_size;
+
+	if (m_hdr->magic != RWMEM_SAMPLE_MAGIC)
+		throw runtime_error("Bad sample ring magic number");
+
+	if (m_hdr->version != RWMEM_SAMPLE_VERSION)
+		throw runtime_error("Bad sample ring version");
+
+	atomic_thread_fence(memory_order_acquire);
+}
+
+SampleReader::~SampleReader()
+{
+	munmap((void*)m_hdr, m_len);
+}
+
+uint64_t SampleReader::reg_addr(uint32_t idx) const
+{
+	if (idx >= num_regs())
+		throw runtime_error("register idx too high");
+
+	return ring_addrs(m_hdr)[idx];
+}
+
+unsigned SampleReader::reg_size(uint32_t idx) const
+{
+	if (idx >= num_regs())
+		throw runtime_error("register idx too high");
+
+	return ring_sizes(m_hdr)[idx];
+}
+
+bool SampleReader::read(uint64_t index, Sample* sample) const
+{
+	if (index >= head())
+		return false;
+
+	const SampleSlot* slot = ring_slot(m_hdr, index);
+	const uint64_t seq = 2 * index + 2;
+
+	if (slot->seq.load(memory_order_acquire) != seq)
+		return false;
+
+	sample->index = index;
+	sample->timestamp = slot->timestamp;
+	sample->values.assign(slot->values(), slot->values() + m_hdr->num_regs);
+
+	atomic_thread_fence(memory_order_acquire);
+
+	// Overwritten while we were copying?
+	return slot->seq.load(memory_order_relaxed) == seq;
+}
+
+bool SampleReader::latest(Sample* sample) const
+{
+	while (true) {
+		uint64_t h = head();
+
+		if (h == 0)
+			return false;
+
+		if (read(h - 1, sample))
+			return true;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "itarget.h"
+#include "realtime.h"
+
+const uint32_t RWMEM_SAMPLE_MAGIC = 0x00e15a3b;
+const uint32_t RWMEM_SAMPLE_VERSION = 1;
+
+/*
+ * Shared memory layout: SampleRingHeader, the sampled register addresses and
+ * sizes, then num_slots slots of slot_size bytes, each a SampleSlot followed
+ * by num_regs values.
+ *
+ * The ring has a single producer and any number of consumers. A slot's seq
+ * is odd while the producer writes it, and 2 * (sample index + 1) when the
+ * sample is complete. Consumers copy the slot and check that seq did not
+ * change, so they never take locks or block the producer.
+ */
+struct SampleRingHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_regs;
+	uint32_t num_slots;	// power of two
+	uint64_t interval;	// ns
+	uint64_t slot_size;	// bytes
+	uint64_t slots_offset;	// bytes from the start of the segment
+	std::atomic<uint64_t> head;	// number of samples written
+};
+
+struct SampleSlot
+{
+	std::atomic<uint64_t> seq;
+	uint64_t timestamp;	// CLOCK_MONOTONIC, ns
+
+	uint64_t* values() { return (uint64_t*)(this + 1); }
+	const uint64_t* values() const { return (const uint64_t*)(this + 1); }
+};
+
+struct Sample
+{
+	uint64_t index;
+	uint64_t timestamp;
+	std::vector<uint64_t> values;
+};
+
+/*
+ * Reads a set of registers at a fixed rate into a sample ring in a POSIX
+ * shared memory segment, from which any number of SampleReaders can read.
+ */
+class Sampler
+{
+public:
+	Sampler(std::shared_ptr<ITarget> target, const std::string& name,
+		const std::vector<uint64_t>& addrs, const std::vector<unsigned>& sizes,
+		uint32_t num_slots);
+	~Sampler();
+
+	// Sample in a background thread
+	void start(uint64_t interval_ns);
+	void stop();
+
+	// Sample in the calling thread, 'count' samples or forever if 0
+	void run(uint64_t interval_ns, uint64_t count);
+
+	// Take one sample now
+	void sample();
+
+	// Apply 'cfg' to the sampling thread and busy-wait for the sample
+	// times instead of sleeping on a timer. Call before start() or run().
+	void set_realtime(const RealtimeConfig& cfg);
+
+	// How late the samples were taken, valid after stop() or run()
+	const JitterStats& jitter() const { return m_jitter; }
+
+private:
+	std::shared_ptr<ITarget> m_target;
+	std::string m_name;
+
+	std::vector<uint64_t> m_addrs;
+	std::vector<unsigned> m_sizes;
+
+	SampleRingHeader* m_hdr;
+	size_t m_len;
+
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+
+	bool m_realtime;
+	RealtimeConfig m_rt_config;
+	JitterStats m_jitter;
+
+	void loop(uint64_t interval_ns, uint64_t count);
+};
+
+class SampleReader
+{
+public:
+	SampleReader(const std::string& name);
+	~SampleReader();
+
+	uint32_t num_regs() const { return m_hdr->num_regs; }
+	uint64_t reg_addr(uint32_t idx) const;
+	unsigned reg_size(uint32_t idx) const;
+	uint64_t interval() const { return m_hdr->interval; }
+
+	// Number of samples written so far
+	uint64_t head() const { return m_hdr->head.load(std::memory_order_acquire); }
+
+	// Copy sample 'index'. Returns false if the sample has not been written
+	// yet or has already been overwritten.
+	bool read(uint64_t index, Sample* sample) const;
+
+	// Copy the most recent sample. Returns false if there are no samples.
+	bool latest(Sample* sample) const;
+
+private:
+	const SampleRingHeader* m_hdr;
+	size_t m_len;
+};
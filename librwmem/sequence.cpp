@@ -0,0 +1,113 @@
+#include "sequence.h"
+
+#include <time.h>
+
+#include "realtime.h"
+#include "wait.h"
+
+using namespace std;
+
+// The largest range mapped at once, as for register lists
+static const uint64_t max_map_span = 16 * 1024 * 1024;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Map the register of steps[first] and those of the following steps, as
+// many as fit in max_map_span
+static void map_steps(ITarget* target, const vector<SeqStep>& steps, size_t first,
+		      uint64_t* lo, uint64_t* hi)
+{
+	uint64_t l = steps[first].addr;
+	uint64_t h = l + steps[first].numbytes;
+
+	for (size_t i = first + 1; i < steps.size(); ++i) {
+		const SeqStep& s = steps[i];
+
+		if (s.op == SeqOp::Delay)
+			continue;
+
+		const uint64_t nl = min(l, s.addr);
+		const uint64_t nh = max(h, s.addr + s.numbytes);
+
+		if (nh - nl > max_map_span)
+			break;
+
+		l = nl;
+		h = nh;
+	}
+
+	target->map(l, h - l);
+
+	*lo = l;
+	*hi = h;
+}
+
+vector<SeqResult> run_sequence(ITarget* target, const vector<SeqStep>& steps, uint64_t spin_ns)
+{
+	vector<SeqResult> results;
+	results.reserve(steps.size());
+
+	// The mapped range, empty to begin with
+	uint64_t map_lo = 1, map_hi = 0;
+
+	// The first mapping is made before the clock starts
+	for (size_t i = 0; i < steps.size(); ++i) {
+		if (steps[i].op != SeqOp::Delay) {
+			map_steps(target, steps, i, &map_lo, &map_hi);
+			break;
+		}
+	}
+
+	const uint64_t start = now_ns();
+	uint64_t t = start;
+
+	for (size_t i = 0; i < steps.size(); ++i) {
+		const SeqStep& s = steps[i];
+		SeqResult res { t - start, 0, 0, true };
+
+		if (s.op != SeqOp::Delay && (s.addr < map_lo || s.addr + s.numbytes > map_hi))
+			map_steps(target, steps, i, &map_lo, &map_hi);
+
+		switch (s.op) {
+		case SeqOp::Write:
+			if (s.mask == GENMASK(s.numbytes * 8 - 1, 0))
+				target->write(s.addr, s.numbytes, s.value);
+			else
+				target->update_bits(s.addr, s.numbytes, s.mask, s.value);
+			break;
+
+		case SeqOp::Read:
+			res.value = target->read(s.addr, s.numbytes);
+			break;
+
+		case SeqOp::Delay:
+			sleep_until_ns(t + s.time, spin_ns);
+			break;
+
+		case SeqOp::Poll: {
+			WaitResult w = wait_for_value(target, s.addr, s.numbytes, s.mask, s.value,
+						      s.negate, s.time);
+			res.value = w.value;
+			res.ok = w.matched;
+			break;
+		}
+		}
+
+		const uint64_t end = now_ns();
+
+		res.duration = end - t;
+		results.push_back(res);
+
+		if (!res.ok)
+			break;
+
+		t = end;
+	}
+
+	return results;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "itarget.h"
+
+/*
+ * Register access sequences with timed delays, e.g. for power and clock
+ * bring-up: "write X, wait 10 us, write Y, poll Z". The whole sequence runs
+ * in the calling thread without any other work between the steps.
+ */
+
+enum class SeqOp
+{
+	Write,
+	Read,
+	Delay,
+	Poll,
+};
+
+struct SeqStep
+{
+	SeqOp op;
+	uint64_t addr;
+	unsigned numbytes;
+	uint64_t mask;		// bits written or polled
+	uint64_t value;		// value written or polled for, within mask
+	bool negate;		// poll until the value differs from 'value'
+	uint64_t time;		// delay, or poll timeout, ns
+};
+
+struct SeqResult
+{
+	uint64_t start;		// ns since the start of the sequence
+	uint64_t duration;	// ns
+	uint64_t value;		// value read or last value polled
+	bool ok;		// false if the poll timed out
+};
+
+/*
+ * Run the steps in order. Writes to only part of a register use
+ * update_bits(). A delay lasts 'time' from the end of the previous step: it
+ * sleeps and then spins the last 'spin_ns' to end on time. The sequence
+ * stops after a poll that times out, so fewer results than steps are then
+ * returned. The target is mapped here, up to 16 MiB of registers at a time,
+ * the first time before the sequence starts and later within the step
+ * that needs a new mapping.
+ */
+std::vector<SeqResult> run_sequence(ITarget* target, const std::vector<SeqStep>& steps,
+				    uint64_t spin_ns);
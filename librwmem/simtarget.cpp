@@ -0,0 +1,167 @@
+#include "simtarget.h"
+
+#include <algorithm>
+#include <time.h>
+#include <inttypes.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+SimTarget::SimTarget(const RegisterFile& regfile, Endianness data_endianness)
+	: m_last_block(nullptr), m_data_endianness(data_endianness),
+	  m_read_latency(0), m_write_latency(0)
+{
+	const RegisterFileData* rfd = regfile.data();
+
+	for (unsigned bidx = 0; bidx < rfd->num_blocks(); ++bidx) {
+		const RegisterBlockData* rbd = rfd->at(bidx);
+
+		SimBlock b;
+		b.base = rbd->offset();
+		b.size = rbd->size();
+		b.mem.resize(b.size);
+		b.reset.resize(b.size);
+		b.ro.resize(b.size);
+		b.w1c.resize(b.size);
+
+		m_blocks.push_back(move(b));
+	}
+
+	sort(m_blocks.begin(), m_blocks.end(),
+	     [](const SimBlock& a, const SimBlock& b) { return a.base < b.base; });
+}
+
+SimTarget::~SimTarget()
+{
+}
+
+const SimTarget::SimBlock* SimTarget::find_block(uint64_t addr, unsigned numbytes) const
+{
+	const SimBlock* b = m_last_block;
+
+	if (!b || addr < b->base || addr + numbytes > b->base + b->size) {
+		auto it = upper_bound(m_blocks.begin(), m_blocks.end(), addr,
+				      [](uint64_t a, const SimBlock& b) { return a < b.base; });
+
+		ERR_ON(it == m_blocks.begin(), "Address %#" PRIx64 " not in any simulated block", addr);
+
+		b = &*(it - 1);
+
+		ERR_ON(addr + numbytes > b->base + b->size,
+		       "Address %#" PRIx64 " not in any simulated block", addr);
+
+		m_last_block = b;
+	}
+
+	return b;
+}
+
+SimTarget::SimBlock* SimTarget::find_block(uint64_t addr, unsigned numbytes)
+{
+	return const_cast<SimBlock*>(static_cast<const SimTarget*>(this)->find_block(addr, numbytes));
+}
+
+static void sim_delay(uint32_t ns)
+{
+	if (ns == 0)
+		return;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	const uint64_t end = ts.tv_sec * 1000000000ull + ts.tv_nsec + ns;
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	} while (ts.tv_sec * 1000000000ull + ts.tv_nsec < end);
+}
+
+uint64_t SimTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	sim_delay(m_read_latency);
+
+	return peek(addr, numbytes);
+}
+
+void SimTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	sim_delay(m_write_latency);
+
+	SimBlock* b = find_block(addr, numbytes);
+	const uint64_t idx = addr - b->base;
+
+	uint8_t buf[8];
+	host_to_device(value, numbytes, buf, m_data_endianness);
+
+	for (unsigned i = 0; i < numbytes; ++i) {
+		const uint8_t old = b->mem[idx + i];
+		const uint8_t ro = b->ro[idx + i];
+		const uint8_t w1c = b->w1c[idx + i];
+
+		b->mem[idx + i] = (old & ro) | (old & w1c & ~buf[i]) | (buf[i] & ~ro & ~w1c);
+	}
+}
+
+uint32_t SimTarget::read32(uint64_t addr) const
+{
+	return read(addr, 4);
+}
+
+void SimTarget::write32(uint64_t addr, uint32_t value)
+{
+	write(addr, 4, value);
+}
+
+uint64_t SimTarget::peek(uint64_t addr, unsigned numbytes) const
+{
+	const SimBlock* b = find_block(addr, numbytes);
+
+	uint8_t buf[8];
+	copy_n(&b->mem[addr - b->base], numbytes, buf);
+
+	return device_to_host(buf, numbytes, m_data_endianness);
+}
+
+void SimTarget::poke(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	set_bytes(&SimBlock::mem, addr, numbytes, value);
+}
+
+void SimTarget::set_bytes(vector<uint8_t> SimBlock::*array, uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	SimBlock* b = find_block(addr, numbytes);
+
+	uint8_t buf[8];
+	host_to_device(value, numbytes, buf, m_data_endianness);
+
+	copy_n(buf, numbytes, &(b->*array)[addr - b->base]);
+}
+
+void SimTarget::set_reset_value(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	set_bytes(&SimBlock::reset, addr, numbytes, value);
+	set_bytes(&SimBlock::mem, addr, numbytes, value);
+}
+
+void SimTarget::set_read_only(uint64_t addr, unsigned numbytes, uint64_t mask)
+{
+	set_bytes(&SimBlock::ro, addr, numbytes, mask);
+}
+
+void SimTarget::set_write_1_to_clear(uint64_t addr, unsigned numbytes, uint64_t mask)
+{
+	set_bytes(&SimBlock::w1c, addr, numbytes, mask);
+}
+
+void SimTarget::set_latency(uint32_t read_ns, uint32_t write_ns)
+{
+	m_read_latency = read_ns;
+	m_write_latency = write_ns;
+}
+
+void SimTarget::reset()
+{
+	for (SimBlock& b : m_blocks)
+		b.mem = b.reset;
+}
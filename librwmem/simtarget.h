@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "itarget.h"
+#include "regs.h"
+
+/*
+ * In-process register target backed by plain memory. Storage is allocated
+ * for every block in the register file, so everything that works on real
+ * hardware can be exercised on any Linux host.
+ */
+class SimTarget : public ITarget
+{
+public:
+	SimTarget(const RegisterFile& regfile, Endianness data_endianness);
+	~SimTarget();
+
+	void map(uint64_t offset, uint64_t length) { }
+	void unmap() { }
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const;
+	void write(uint64_t addr, unsigned numbytes, uint64_t value);
+
+	uint32_t read32(uint64_t addr) const;
+	void write32(uint64_t addr, uint32_t value);
+
+	// Register semantics. Masks are in register bit order.
+	void set_reset_value(uint64_t addr, unsigned numbytes, uint64_t value);
+	void set_read_only(uint64_t addr, unsigned numbytes, uint64_t mask);
+	void set_write_1_to_clear(uint64_t addr, unsigned numbytes, uint64_t mask);
+
+	// Busy-wait latency added to every access
+	void set_latency(uint32_t read_ns, uint32_t write_ns);
+
+	// Return all registers to their reset values
+	void reset();
+
+	// Backdoor access, bypasses register semantics and latency
+	uint64_t peek(uint64_t addr, unsigned numbytes) const;
+	void poke(uint64_t addr, unsigned numbytes, uint64_t value);
+
+private:
+	struct SimBlock
+	{
+		uint64_t base;
+		uint64_t size;
+
+		std::vector<uint8_t> mem;
+		std::vector<uint8_t> reset;
+		std::vector<uint8_t> ro;
+		std::vector<uint8_t> w1c;
+	};
+
+	std::vector<SimBlock> m_blocks;
+	mutable const SimBlock* m_last_block;
+
+	Endianness m_data_endianness;
+
+	uint32_t m_read_latency;
+	uint32_t m_write_latency;
+
+	const SimBlock* find_block(uint64_t addr, unsigned numbytes) const;
+	SimBlock* find_block(uint64_t addr, unsigned numbytes);
+
+	void set_bytes(std::vector<uint8_t> SimBlock::*array, uint64_t addr, unsigned numbytes, uint64_t value);
+};
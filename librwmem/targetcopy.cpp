@@ -0,0 +1,112 @@
+#include "targetcopy.h"
+
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#include "mmaptarget.h"
+#include "parallelrange.h"
+#include "byteorder.h"
+#include "helpers.h"
+
+using namespace std;
+
+// Chunk size for the buffered copy, and for splitting a memory copy
+// between threads
+static const uint64_t copy_chunk_size = 1024 * 1024;
+
+// Smaller copies are likely to be used soon, so keep them in the cache
+static const size_t stream_threshold = 256 * 1024;
+
+void stream_copy(void* dst, const void* src, size_t len)
+{
+#if defined(__x86_64__)
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+
+	// Align the destination for the streaming stores
+	const size_t head = min(len, (size_t)(-(uintptr_t)d & 15));
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+
+	for (; len >= 64; d += 64, s += 64, len -= 64) {
+		__m128i v0 = _mm_loadu_si128((const __m128i*)s + 0);
+		__m128i v1 = _mm_loadu_si128((const __m128i*)s + 1);
+		__m128i v2 = _mm_loadu_si128((const __m128i*)s + 2);
+		__m128i v3 = _mm_loadu_si128((const __m128i*)s + 3);
+
+		_mm_stream_si128((__m128i*)d + 0, v0);
+		_mm_stream_si128((__m128i*)d + 1, v1);
+		_mm_stream_si128((__m128i*)d + 2, v2);
+		_mm_stream_si128((__m128i*)d + 3, v3);
+	}
+
+	// Streaming stores are weakly ordered
+	_mm_sfence();
+
+	memcpy(d, s, len);
+#else
+	// The C library's memcpy already uses the widest stores
+	memcpy(dst, src, len);
+#endif
+}
+
+static void memory_copy(MMapTarget* dst, uint64_t dst_addr, const MMapTarget* src, uint64_t src_addr,
+			uint64_t length, unsigned num_threads)
+{
+	uint8_t* d = (uint8_t*)dst->mapped_ptr(dst_addr, length);
+	const uint8_t* s = (const uint8_t*)src->mapped_ptr(src_addr, length);
+
+	dst->mark_dirty(dst_addr, length);
+
+	if (length < stream_threshold) {
+		memcpy(d, s, length);
+		return;
+	}
+
+	ParallelRange pr(src_addr, length, copy_chunk_size, num_threads);
+
+	pr.run(false, [&](const RangeChunk& c) {
+		const uint64_t offset = c.addr - src_addr;
+		stream_copy(d + offset, s + offset, c.length);
+	}, [](const RangeChunk& c) { });
+}
+
+void target_copy(const CopyEndpoint& dst, const CopyEndpoint& src, uint64_t length,
+		 unsigned num_threads)
+{
+	FAIL_IF(length % src.numbytes || length % dst.numbytes, "copy length not aligned");
+
+	MMapTarget* dst_mm = dynamic_cast<MMapTarget*>(dst.target);
+	MMapTarget* src_mm = dynamic_cast<MMapTarget*>(src.target);
+
+	if (dst_mm && src_mm && dst_mm->is_memory() && src_mm->is_memory() &&
+	    dst.endianness == src.endianness) {
+		memory_copy(dst_mm, dst.addr, src_mm, src.addr, length, num_threads);
+		return;
+	}
+
+	vector<uint8_t> buf(min(length, copy_chunk_size));
+
+	for (uint64_t offset = 0; offset < length; ) {
+		const uint64_t n = min(length - offset, (uint64_t)buf.size());
+
+		src.target->read_block(src.addr + offset, src.numbytes, n / src.numbytes, buf.data());
+
+		if (src.numbytes != dst.numbytes) {
+			// Back to the source's byte order, and read that at the destination width
+			convert_byte_order(buf.data(), buf.data(), n / src.numbytes, src.numbytes, src.endianness);
+			convert_byte_order(buf.data(), buf.data(), n / dst.numbytes, dst.numbytes, src.endianness);
+		}
+
+		dst.target->write_block(dst.addr + offset, dst.numbytes, n / dst.numbytes, buf.data());
+
+		offset += n;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "itarget.h"
+
+// One side of a copy: registers of 'numbytes' bytes in 'endianness',
+// starting at 'addr' of 'target'
+struct CopyEndpoint
+{
+	ITarget* target;
+	uint64_t addr;
+	unsigned numbytes;
+	Endianness endianness;
+};
+
+/*
+ * Copy 'length' bytes from one target to another. Both ranges must be
+ * mapped, and aligned to their access sizes. The values are read at the
+ * source width and converted in bulk to the destination endianness. If the
+ * widths differ, the values are split or joined in the source byte order,
+ * so that with the same endianness on both sides the bytes are copied as is.
+ *
+ * Copies between two mmap targets of plain memory (see
+ * MMapTarget::is_memory()) with the same endianness are done with wide
+ * non-temporal stores, in chunks over num_threads threads (0 = one per CPU).
+ * Everything else goes through the targets' read_block() and write_block()
+ * a chunk at a time, so i2c targets get transfer sized writes.
+ */
+void target_copy(const CopyEndpoint& dst, const CopyEndpoint& src, uint64_t length,
+		 unsigned num_threads = 1);
+
+// memcpy() for large copies, with stores that bypass the cache where the
+// CPU has them. The regions must not overlap.
+void stream_copy(void* dst, const void* src, size_t len);
@@ -0,0 +1,352 @@
+#include "timeseries.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+static const size_t checkpoint_interval = 64;
+
+static void put_le(vector<uint8_t>& buf, uint64_t value, unsigned numbytes)
+{
+	for (unsigned i = 0; i < numbytes; ++i)
+		buf.push_back(value >> (i * 8));
+}
+
+static uint64_t get_le(const uint8_t* p, unsigned numbytes)
+{
+	uint64_t v = 0;
+
+	for (unsigned i = 0; i < numbytes; ++i)
+		v |= (uint64_t)p[i] << (i * 8);
+
+	return v;
+}
+
+static void put_varint(vector<uint8_t>& buf, uint64_t v)
+{
+	while (v >= 0x80) {
+		buf.push_back((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+
+	buf.push_back(v);
+}
+
+static uint64_t get_varint(const uint8_t*& p, const uint8_t* end)
+{
+	uint64_t v = 0;
+
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		if (p == end)
+			break;
+
+		const uint8_t b = *p++;
+		v |= (uint64_t)(b & 0x7f) << shift;
+
+		if (!(b & 0x80))
+			return v;
+	}
+
+	throw runtime_error("Corrupt time-series frame");
+}
+
+TimeSeriesWriter::TimeSeriesWriter(const string& filename,
+				   const vector<uint64_t>& addrs, const vector<unsigned>& sizes)
+	: m_sizes(sizes), m_prev(addrs.size()), m_num_frames(0)
+{
+	if (addrs.empty() || addrs.size() != sizes.size())
+		throw invalid_argument("Bad time-series register list");
+
+	m_file = fopen(filename.c_str(), "w");
+	ERR_ON_ERRNO(!m_file, "Failed to open time-series file '%s'", filename.c_str());
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	SeriesHeader hdr { };
+	hdr.magic = htole32(RWMEM_SERIES_MAGIC);
+	hdr.version = htole32(RWMEM_SERIES_VERSION);
+	hdr.num_regs = htole32(addrs.size());
+	hdr.start_time = htole64(ts.tv_sec * 1000000000ull + ts.tv_nsec);
+
+	m_buf.assign((uint8_t*)&hdr, (uint8_t*)(&hdr + 1));
+
+	for (uint64_t addr : addrs)
+		put_le(m_buf, addr, 8);
+
+	for (unsigned size : sizes)
+		m_buf.push_back(size);
+
+	size_t l = fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+	ERR_ON_ERRNO(l != m_buf.size(), "Failed to write time-series header");
+}
+
+TimeSeriesWriter::~TimeSeriesWriter()
+{
+	fclose(m_file);
+}
+
+void TimeSeriesWriter::write_frame(uint64_t timestamp, SeriesFrameType type)
+{
+	SeriesFrameHeader fh { };
+	fh.timestamp = htole64(timestamp);
+	fh.length = htole32(m_buf.size());
+	fh.type = (uint8_t)type;
+
+	size_t l = fwrite(&fh, sizeof(fh), 1, m_file);
+	ERR_ON_ERRNO(l != 1, "Failed to write time-series frame");
+
+	l = fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+	ERR_ON_ERRNO(l != m_buf.size(), "Failed to write time-series frame");
+
+	fflush(m_file);
+
+	m_num_frames++;
+}
+
+void TimeSeriesWriter::add(uint64_t timestamp, const uint64_t* values)
+{
+	const size_t num_regs = m_prev.size();
+
+	m_buf.clear();
+
+	if (m_num_frames == 0) {
+		for (size_t i = 0; i < num_regs; ++i)
+			put_le(m_buf, values[i], m_sizes[i]);
+
+		write_frame(timestamp, SeriesFrameType::Key);
+		copy(values, values + num_regs, m_prev.begin());
+		return;
+	}
+
+	m_buf.resize(DIV_ROUND_UP(num_regs, 8));
+
+	bool changed = false;
+
+	for (size_t i = 0; i < num_regs; ++i) {
+		if (values[i] == m_prev[i])
+			continue;
+
+		m_buf[i / 8] |= 1 << (i % 8);
+		changed = true;
+	}
+
+	if (!changed)
+		return;
+
+	for (size_t i = 0; i < num_regs; ++i) {
+		if (values[i] == m_prev[i])
+			continue;
+
+		put_varint(m_buf, values[i] ^ m_prev[i]);
+		m_prev[i] = values[i];
+	}
+
+	write_frame(timestamp, SeriesFrameType::Delta);
+}
+
+TimeSeriesReader::TimeSeriesReader(const string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	ERR_ON_ERRNO(fd < 0, "Failed to open time-series file '%s'", filename.c_str());
+
+	struct stat st;
+	int r = fstat(fd, &st);
+	ERR_ON_ERRNO(r, "Failed to get time-series file stat");
+
+	m_len = st.st_size;
+
+	if (m_len < sizeof(SeriesHeader))
+		throw runtime_error("Bad time-series file size");
+
+	void* base = mmap(NULL, m_len, PROT_READ, MAP_SHARED, fd, 0);
+	ERR_ON_ERRNO(base == MAP_FAILED, "Failed to mmap time-series file '%s'", filename.c_str());
+
+	close(fd);
+
+	m_data = (const uint8_t*)base;
+
+	const SeriesHeader* hdr = (const SeriesHeader*)m_data;
+
+	if (le32toh(hdr->magic) != RWMEM_SERIES_MAGIC)
+		throw runtime_error("Bad time-series magic number");
+
+	if (le32toh(hdr->version) != RWMEM_SERIES_VERSION)
+		throw runtime_error("Bad time-series version");
+
+	m_num_regs = le32toh(hdr->num_regs);
+	m_start_time = le64toh(hdr->start_time);
+
+	const size_t regs_len = (size_t)m_num_regs * 9;
+
+	if (m_len - sizeof(SeriesHeader) < regs_len)
+		throw runtime_error("Bad time-series file size");
+
+	m_addrs = m_data + sizeof(SeriesHeader);
+	m_sizes = m_addrs + m_num_regs * 8;
+
+	for (uint32_t i = 0; i < m_num_regs; ++i) {
+		if (m_sizes[i] == 0 || m_sizes[i] > 8)
+			throw runtime_error("Bad time-series register size");
+	}
+
+	const uint8_t* p = m_sizes + m_num_regs;
+	const uint8_t* end = m_data + m_len;
+
+	vector<uint64_t> state(m_num_regs);
+
+	// A truncated last frame, from a killed capture, is ignored
+	while ((size_t)(end - p) >= sizeof(SeriesFrameHeader)) {
+		const SeriesFrameHeader* fh = (const SeriesFrameHeader*)p;
+		const uint32_t length = le32toh(fh->length);
+		const SeriesFrameType type = (SeriesFrameType)fh->type;
+
+		if ((size_t)(end - p) - sizeof(SeriesFrameHeader) < length)
+			break;
+
+		if ((type == SeriesFrameType::Key) != m_frames.empty() ||
+		    (type != SeriesFrameType::Key && type != SeriesFrameType::Delta))
+			throw runtime_error("Bad time-series frame type");
+
+		Frame f { le64toh(fh->timestamp), type, p + sizeof(SeriesFrameHeader), length };
+
+		if (!m_frames.empty() && f.timestamp < m_frames.back().timestamp)
+			throw runtime_error("Time-series timestamps not in order");
+
+		apply(f, state);
+
+		if (m_frames.size() % checkpoint_interval == 0)
+			m_checkpoints.push_back(state);
+
+		m_frames.push_back(f);
+
+		p += sizeof(SeriesFrameHeader) + length;
+	}
+}
+
+TimeSeriesReader::~TimeSeriesReader()
+{
+	munmap((void*)m_data, m_len);
+}
+
+uint64_t TimeSeriesReader::reg_addr(uint32_t idx) const
+{
+	if (idx >= m_num_regs)
+		throw runtime_error("register idx too high");
+
+	return get_le(m_addrs + idx * 8, 8);
+}
+
+unsigned TimeSeriesReader::reg_size(uint32_t idx) const
+{
+	if (idx >= m_num_regs)
+		throw runtime_error("register idx too high");
+
+	return m_sizes[idx];
+}
+
+uint64_t TimeSeriesReader::frame_timestamp(size_t idx) const
+{
+	if (idx >= m_frames.size())
+		throw runtime_error("frame idx too high");
+
+	return m_frames[idx].timestamp;
+}
+
+void TimeSeriesReader::apply(const Frame& f, vector<uint64_t>& state) const
+{
+	const uint8_t* p = f.data;
+	const uint8_t* end = f.data + f.length;
+
+	if (f.type == SeriesFrameType::Key) {
+		for (uint32_t i = 0; i < m_num_regs; ++i) {
+			if ((size_t)(end - p) < m_sizes[i])
+				throw runtime_error("Corrupt time-series frame");
+
+			state[i] = get_le(p, m_sizes[i]);
+			p += m_sizes[i];
+		}
+
+		return;
+	}
+
+	const uint8_t* bitmap = p;
+	p += DIV_ROUND_UP(m_num_regs, 8);
+
+	if (p > end)
+		throw runtime_error("Corrupt time-series frame");
+
+	for (uint32_t i = 0; i < m_num_regs; ++i) {
+		if (bitmap[i / 8] & (1 << (i % 8)))
+			state[i] ^= get_varint(p, end);
+	}
+}
+
+vector<uint64_t> TimeSeriesReader::state_at(uint64_t timestamp) const
+{
+	auto it = upper_bound(m_frames.begin(), m_frames.end(), timestamp,
+			      [](uint64_t ts, const Frame& f) { return ts < f.timestamp; });
+
+	if (it == m_frames.begin())
+		throw runtime_error("timestamp before the first frame");
+
+	const size_t last = it - m_frames.begin() - 1;
+	const size_t cp = last / checkpoint_interval;
+
+	vector<uint64_t> state = m_checkpoints[cp];
+
+	for (size_t i = cp * checkpoint_interval + 1; i <= last; ++i)
+		apply(m_frames[i], state);
+
+	return state;
+}
+
+vector<SeriesChange> TimeSeriesReader::history(uint32_t idx) const
+{
+	if (idx >= m_num_regs)
+		throw runtime_error("register idx too high");
+
+	vector<SeriesChange> changes;
+	vector<uint64_t> state(m_num_regs);
+
+	for (const Frame& f : m_frames) {
+		const uint64_t old = state[idx];
+
+		apply(f, state);
+
+		if (changes.empty() || state[idx] != old)
+			changes.push_back(SeriesChange { f.timestamp, state[idx] });
+	}
+
+	return changes;
+}
+
+vector<vector<SeriesChange>> TimeSeriesReader::histories() const
+{
+	vector<vector<SeriesChange>> changes(m_num_regs);
+	vector<uint64_t> state(m_num_regs);
+	vector<uint64_t> prev(m_num_regs);
+
+	for (size_t n = 0; n < m_frames.size(); ++n) {
+		const Frame& f = m_frames[n];
+
+		apply(f, state);
+
+		for (uint32_t i = 0; i < m_num_regs; ++i) {
+			if (n == 0 || state[i] != prev[i]) {
+				changes[i].push_back(SeriesChange { f.timestamp, state[i] });
+				prev[i] = state[i];
+			}
+		}
+	}
+
+	return changes;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <endian.h>
+
+const uint32_t RWMEM_SERIES_MAGIC = 0x00e15e71;
+const uint32_t RWMEM_SERIES_VERSION = 1;
+
+/*
+ * Time-series file layout: SeriesHeader, the register addresses (uint64_t)
+ * and sizes (uint8_t), then frames, each a SeriesFrameHeader and its data.
+ * The first frame is a keyframe holding every register value in 'size'
+ * bytes. The later frames hold only the registers that changed: a bitmap
+ * with a bit per register, then for each changed register the XOR of the
+ * new and old value as a LEB128 varint. Frames with no changes are not
+ * written. All fields are little endian.
+ */
+
+enum class SeriesFrameType : uint8_t
+{
+	Key = 0,
+	Delta = 1,
+};
+
+struct __attribute__(( packed )) SeriesHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_regs;
+	uint32_t reserved;
+	uint64_t start_time;	// CLOCK_REALTIME, ns
+};
+
+struct __attribute__(( packed )) SeriesFrameHeader
+{
+	uint64_t timestamp;	// ns since start_time
+	uint32_t length;	// bytes of data after the header
+	uint8_t type;
+	uint8_t reserved[3];
+};
+
+class TimeSeriesWriter
+{
+public:
+	TimeSeriesWriter(const std::string& filename,
+			 const std::vector<uint64_t>& addrs, const std::vector<unsigned>& sizes);
+	~TimeSeriesWriter();
+
+	// Record the values of all registers at 'timestamp', ns since the
+	// start. Each frame is flushed, so the file is valid up to the last
+	// frame even if the capture is killed.
+	void add(uint64_t timestamp, const uint64_t* values);
+
+	uint64_t num_frames() const { return m_num_frames; }
+
+private:
+	FILE* m_file;
+
+	std::vector<unsigned> m_sizes;
+	std::vector<uint64_t> m_prev;
+	std::vector<uint8_t> m_buf;
+
+	uint64_t m_num_frames;
+
+	void write_frame(uint64_t timestamp, SeriesFrameType type);
+};
+
+struct SeriesChange
+{
+	uint64_t timestamp;
+	uint64_t value;
+};
+
+class TimeSeriesReader
+{
+public:
+	TimeSeriesReader(const std::string& filename);
+	~TimeSeriesReader();
+
+	uint32_t num_regs() const { return m_num_regs; }
+	uint64_t reg_addr(uint32_t idx) const;
+	unsigned reg_size(uint32_t idx) const;
+
+	uint64_t start_time() const { return m_start_time; }
+
+	size_t num_frames() const { return m_frames.size(); }
+	uint64_t frame_timestamp(size_t idx) const;
+
+	// The register values as of 'timestamp', i.e. after the last frame at
+	// or before it. Throws if the timestamp is before the keyframe.
+	std::vector<uint64_t> state_at(uint64_t timestamp) const;
+
+	// The initial value and every change of a register
+	std::vector<SeriesChange> history(uint32_t idx) const;
+
+	// history() of every register, decoding each frame only once
+	std::vector<std::vector<SeriesChange>> histories() const;
+
+private:
+	struct Frame
+	{
+		uint64_t timestamp;
+		SeriesFrameType type;
+		const uint8_t* data;
+		uint32_t length;
+	};
+
+	const uint8_t* m_data;
+	size_t m_len;
+
+	uint32_t m_num_regs;
+	uint64_t m_start_time;
+	const uint8_t* m_addrs;
+	const uint8_t* m_sizes;
+
+	std::vector<Frame> m_frames;
+
+	// The full state after every checkpoint_interval frames
+	std::vector<std::vector<uint64_t>> m_checkpoints;
+
+	void apply(const Frame& f, std::vector<uint64_t>& state) const;
+};
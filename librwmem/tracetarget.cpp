@@ -0,0 +1,218 @@
+#include "tracetarget.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "helpers.h"
+
+using namespace std;
+
+static const size_t trace_buffer_records = 4096;
+
+// Replay timing spins for the last part of each delay
+static const uint64_t replay_spin_ns = 50000;
+
+static uint64_t clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The live traces, flushed at exit() so that a run ending in an error keeps
+// its last accesses, which are the interesting ones
+static vector<TraceTarget*> s_traces;
+
+// Failures are only reported, as exit() must not be called again here
+void TraceTarget::flush_all()
+{
+	for (const TraceTarget* t : s_traces) {
+		if (!t->write_records())
+			fprintf(stderr, "Failed to write trace: %s\n", strerror(errno));
+	}
+}
+
+TraceTarget::TraceTarget(shared_ptr<ITarget> target, const string& filename)
+	: m_target(target), m_records(trace_buffer_records), m_num_records(0)
+{
+	m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	ERR_ON_ERRNO(m_fd < 0, "Failed to open trace file '%s'", filename.c_str());
+
+	TraceHeader hdr;
+	hdr.magic = htole32(RWMEM_TRACE_MAGIC);
+	hdr.version = htole32(RWMEM_TRACE_VERSION);
+	hdr.start_time = htole64(clock_ns(CLOCK_REALTIME));
+
+	ssize_t l = ::write(m_fd, &hdr, sizeof(hdr));
+	ERR_ON_ERRNO(l != sizeof(hdr), "Failed to write trace header");
+
+	m_start = clock_ns(CLOCK_MONOTONIC);
+
+	static bool registered = false;
+
+	if (!registered) {
+		atexit(flush_all);
+		registered = true;
+	}
+
+	s_traces.push_back(this);
+}
+
+TraceTarget::~TraceTarget()
+{
+	s_traces.erase(find(s_traces.begin(), s_traces.end(), this));
+
+	flush_records();
+	close(m_fd);
+}
+
+void TraceTarget::record(TraceOp op, uint64_t addr, unsigned numbytes, uint64_t value) const
+{
+	m_records[m_num_records++].set(clock_ns(CLOCK_MONOTONIC) - m_start, op, addr, numbytes, value);
+
+	if (unlikely(m_num_records == m_records.size()))
+		flush_records();
+}
+
+// Returns false, with errno set, if the write failed. The records are
+// dropped either way, so that they are not written again.
+bool TraceTarget::write_records() const
+{
+	size_t len = m_num_records * sizeof(TraceRecord);
+
+	m_num_records = 0;
+
+	if (len == 0)
+		return true;
+
+	ssize_t l = ::write(m_fd, m_records.data(), len);
+
+	if (l >= 0 && l != (ssize_t)len)
+		errno = ENOSPC;
+
+	return l == (ssize_t)len;
+}
+
+void TraceTarget::flush_records() const
+{
+	bool ok = write_records();
+	ERR_ON_ERRNO(!ok, "Failed to write trace");
+}
+
+void TraceTarget::flush()
+{
+	flush_records();
+}
+
+void TraceTarget::map(uint64_t offset, uint64_t length)
+{
+	record(TraceOp::Map, offset, 0, length);
+	m_target->map(offset, length);
+}
+
+void TraceTarget::unmap()
+{
+	m_target->unmap();
+}
+
+uint64_t TraceTarget::read(uint64_t addr, unsigned numbytes) const
+{
+	uint64_t v = m_target->read(addr, numbytes);
+	record(TraceOp::Read, addr, numbytes, v);
+	return v;
+}
+
+void TraceTarget::write(uint64_t addr, unsigned numbytes, uint64_t value)
+{
+	record(TraceOp::Write, addr, numbytes, value);
+	m_target->write(addr, numbytes, value);
+}
+
+uint32_t TraceTarget::read32(uint64_t addr) const
+{
+	return read(addr, 4);
+}
+
+void TraceTarget::write32(uint64_t addr, uint32_t value)
+{
+	write(addr, 4, value);
+}
+
+uint64_t replay_trace(const string& filename, ITarget* target, bool realtime,
+		      function<void(const TraceDivergence&)> divergence, JitterStats* jitter)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	ERR_ON_ERRNO(fd < 0, "Open trace '%s' failed", filename.c_str());
+
+	struct stat st;
+	int r = fstat(fd, &st);
+	ERR_ON_ERRNO(r, "Failed to get trace file stat");
+
+	ERR_ON((size_t)st.st_size < sizeof(TraceHeader), "Trace file too short");
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	ERR_ON_ERRNO(data == MAP_FAILED, "mmap trace failed");
+
+	close(fd);
+
+	const TraceHeader* hdr = (const TraceHeader*)data;
+
+	if (le32toh(hdr->magic) != RWMEM_TRACE_MAGIC)
+		throw runtime_error("Bad trace magic number");
+
+	if (le32toh(hdr->version) != RWMEM_TRACE_VERSION)
+		throw runtime_error("Bad trace version");
+
+	const TraceRecord* records = (const TraceRecord*)(hdr + 1);
+	const uint64_t num_records = (st.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+
+	const uint64_t start = clock_ns(CLOCK_MONOTONIC);
+
+	uint64_t num_accesses = 0;
+
+	for (uint64_t i = 0; i < num_records; ++i) {
+		const TraceRecord& rec = records[i];
+
+		if (realtime) {
+			const uint64_t late = sleep_until_ns(start + rec.timestamp(), replay_spin_ns);
+
+			if (jitter)
+				jitter->add(late);
+		}
+
+		switch (rec.op()) {
+		case TraceOp::Map:
+			target->map(rec.addr(), rec.value());
+			break;
+
+		case TraceOp::Read: {
+			uint64_t v = target->read(rec.addr(), rec.numbytes());
+			num_accesses++;
+
+			if (v != rec.value() && divergence)
+				divergence(TraceDivergence { i, rec.addr(), rec.numbytes(), rec.value(), v });
+			break;
+		}
+
+		case TraceOp::Write:
+			target->write(rec.addr(), rec.numbytes(), rec.value());
+			num_accesses++;
+			break;
+
+		default:
+			ERR("Bad trace record %" PRIu64, i);
+		}
+	}
+
+	munmap(data, st.st_size);
+
+	return num_accesses;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <endian.h>
+
+#include "itarget.h"
+#include "realtime.h"
+
+const uint32_t RWMEM_TRACE_MAGIC = 0x00e1175a;
+const uint32_t RWMEM_TRACE_VERSION = 1;
+
+enum class TraceOp : uint8_t
+{
+	Read = 0,
+	Write = 1,
+	Map = 2,	// addr = offset, value = length
+};
+
+struct __attribute__(( packed )) TraceHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_time;	// CLOCK_REALTIME, ns
+};
+
+// Trace files are little endian
+struct __attribute__(( packed )) TraceRecord
+{
+	uint64_t timestamp() const { return le64toh(m_timestamp); }
+	uint64_t addr() const { return le64toh(m_addr); }
+	uint64_t value() const { return le64toh(m_value); }
+	unsigned numbytes() const { return m_numbytes; }
+	TraceOp op() const { return (TraceOp)m_op; }
+
+	void set(uint64_t timestamp, TraceOp op, uint64_t addr, unsigned numbytes, uint64_t value)
+	{
+		m_timestamp = htole64(timestamp);
+		m_addr = htole64(addr);
+		m_value = htole64(value);
+		m_numbytes = numbytes;
+		m_op = (uint8_t)op;
+	}
+
+private:
+	uint64_t m_timestamp;	// ns since the start of the trace
+	uint64_t m_addr;
+	uint64_t m_value;
+	uint8_t m_numbytes;
+	uint8_t m_op;
+};
+
+/*
+ * Wraps another target and records every access into a binary trace file.
+ * Records are buffered in memory and written out in large chunks.
+ */
+class TraceTarget : public ITarget
+{
+public:
+	TraceTarget(std::shared_ptr<ITarget> target, const std::string& filename);
+	~TraceTarget();
+
+	void map(uint64_t offset, uint64_t length);
+	void unmap();
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const;
+	void write(uint64_t addr, unsigned numbytes, uint64_t value);
+
+	uint32_t read32(uint64_t addr) const;
+	void write32(uint64_t addr, uint32_t value);
+
+	void flush();
+
+private:
+	std::shared_ptr<ITarget> m_target;
+	int m_fd;
+	uint64_t m_start;
+
+	mutable std::vector<TraceRecord> m_records;
+	mutable size_t m_num_records;
+
+	static void flush_all();
+
+	void record(TraceOp op, uint64_t addr, unsigned numbytes, uint64_t value) const;
+	bool write_records() const;
+	void flush_records() const;
+};
+
+struct TraceDivergence
+{
+	uint64_t index;
+	uint64_t addr;
+	unsigned numbytes;
+	uint64_t expected;
+	uint64_t value;
+};
+
+/*
+ * Drive the accesses of a trace against a target. With 'realtime' the
+ * recorded timing is reproduced, otherwise the accesses are made as fast as
+ * possible. Reads returning a different value than recorded are reported via
+ * 'divergence'. Returns the number of accesses replayed. If 'jitter' is given,
+ * the lateness of each timed access is added to it.
+ */
+uint64_t replay_trace(const std::string& filename, ITarget* target, bool realtime,
+		      std::function<void(const TraceDivergence&)> divergence,
+		      JitterStats* jitter = nullptr);
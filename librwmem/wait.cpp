@@ -0,0 +1,52 @@
+#include "wait.h"
+
+#include <algorithm>
+#include <time.h>
+
+using namespace std;
+
+// Busy poll for this long before starting to sleep
+static const uint64_t wait_spin_ns = 20000;
+static const uint64_t wait_min_sleep_ns = 1000;
+static const uint64_t wait_max_sleep_ns = 1000000;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+WaitResult wait_for_value(const ITarget* target, uint64_t addr, unsigned numbytes,
+			  uint64_t mask, uint64_t expected, bool negate, uint64_t timeout_ns)
+{
+	const uint64_t start = now_ns();
+	uint64_t sleep_ns = wait_min_sleep_ns;
+
+	expected &= mask;
+
+	while (true) {
+		uint64_t v = target->read(addr, numbytes);
+		uint64_t now = now_ns();
+
+		if (((v & mask) == expected) != negate)
+			return WaitResult { true, v, now - start };
+
+		const uint64_t elapsed = now - start;
+
+		if (elapsed >= timeout_ns)
+			return WaitResult { false, v, elapsed };
+
+		if (elapsed < wait_spin_ns)
+			continue;
+
+		uint64_t ns = min(sleep_ns, timeout_ns - elapsed);
+
+		struct timespec ts;
+		ts.tv_sec = ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+		nanosleep(&ts, nullptr);
+
+		sleep_ns = min(sleep_ns * 2, wait_max_sleep_ns);
+	}
+}
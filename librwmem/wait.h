@@ -0,0 +1,19 @@
+#pragma once
+
+#include "itarget.h"
+
+struct WaitResult
+{
+	bool matched;
+	uint64_t value;		// last value read
+	uint64_t elapsed;	// ns
+};
+
+/*
+ * Poll a register until (value & mask) == expected, or until it differs from
+ * expected if 'negate' is set. Polling starts as a busy loop, so that fast
+ * hardware events are seen within microseconds, and then backs off
+ * exponentially to avoid burning CPU on long waits.
+ */
+WaitResult wait_for_value(const ITarget* target, uint64_t addr, unsigned numbytes,
+			  uint64_t mask, uint64_t expected, bool negate, uint64_t timeout_ns);
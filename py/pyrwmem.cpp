@@ -1,7 +1,18 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/functional.h>
 
 #include "mmaptarget.h"
+#include "simtarget.h"
+#include "tracetarget.h"
+#include "cachedtarget.h"
+#include "cosim.h"
+#include "sampler.h"
+#include "realtime.h"
+#include "sequence.h"
+#include "checksum.h"
+#include "dumpfile.h"
+#include "timeseries.h"
 #include "regs.h"
 #include "mappedregs.h"
 
@@ -51,17 +62,140 @@ PYBIND11_PLUGIN(pyrwmem) {
 
 
 
-	py::class_<MMapTarget>(m, "MMapTargetMap")
+	py::enum_<Endianness>(m, "Endianness")
+			.value("Default", Endianness::Default)
+			.value("Big", Endianness::Big)
+			.value("Little", Endianness::Little)
+			.value("BigSwapped", Endianness::BigSwapped)
+			.value("LittleSwapped", Endianness::LittleSwapped)
+			;
+
+	py::class_<ITarget, shared_ptr<ITarget>>(m, "ITarget")
+			.def("read", &ITarget::read)
+			.def("write", &ITarget::write)
+			;
+
+	// An ITarget, so that it can be used with MappedRegisterBlock,
+	// Sampler, TraceTarget, CachedTarget and run_sequence()
+	py::class_<MMapTarget, ITarget, shared_ptr<MMapTarget>>(m, "MMapTargetMap")
 			.def(py::init<const string&, Endianness, uint64_t, uint64_t>())
+			.def(py::init<const string&, Endianness, bool>(),
+			     py::arg("filename"), py::arg("data_endianness"), py::arg("cached") = false)
+			.def("map", &MMapTarget::map)
+			.def("unmap", &MMapTarget::unmap)
 			.def("read32", &MMapTarget::read32)
 			.def("write32", &MMapTarget::write32)
+			.def("flush", &MMapTarget::flush)
+			.def("set_flush_on_unmap", &MMapTarget::set_flush_on_unmap)
+			;
+
+	py::class_<SimTarget, ITarget, shared_ptr<SimTarget>>(m, "SimTarget")
+			.def(py::init<const RegisterFile&, Endianness>())
+			.def("set_reset_value", &SimTarget::set_reset_value)
+			.def("set_read_only", &SimTarget::set_read_only)
+			.def("set_write_1_to_clear", &SimTarget::set_write_1_to_clear)
+			.def("set_latency", &SimTarget::set_latency)
+			.def("reset", &SimTarget::reset)
+			.def("peek", &SimTarget::peek)
+			.def("poke", &SimTarget::poke)
+			;
+
+	py::class_<CoSimTarget, ITarget, shared_ptr<CoSimTarget>>(m, "CoSimTarget")
+			.def(py::init<const string&>())
+			.def("sync", &CoSimTarget::sync)
+			;
+
+	py::class_<TraceTarget, ITarget, shared_ptr<TraceTarget>>(m, "TraceTarget")
+			.def(py::init<shared_ptr<ITarget>, const string&>())
+			.def("flush", &TraceTarget::flush)
+			;
+
+	py::enum_<CacheMode>(m, "CacheMode")
+			.value("WriteThrough", CacheMode::WriteThrough)
+			.value("WriteBack", CacheMode::WriteBack)
+			;
+
+	py::class_<CachedTarget, ITarget, shared_ptr<CachedTarget>>(m, "CachedTarget")
+			.def(py::init<shared_ptr<ITarget>, CacheMode>())
+			.def("set_volatile", &CachedTarget::set_volatile)
+			.def("sync", &CachedTarget::sync)
+			.def("invalidate", &CachedTarget::invalidate)
+			.def_property_readonly("num_hits", &CachedTarget::num_hits)
+			.def_property_readonly("num_misses", &CachedTarget::num_misses)
+			.def_property_readonly("num_skipped_writes", &CachedTarget::num_skipped_writes)
+			;
+
+	py::class_<DumpTarget, ITarget, shared_ptr<DumpTarget>>(m, "DumpTarget")
+			.def(py::init<const string&, Endianness>())
+			;
+
+	py::class_<TraceDivergence>(m, "TraceDivergence")
+			.def_readonly("index", &TraceDivergence::index)
+			.def_readonly("addr", &TraceDivergence::addr)
+			.def_readonly("numbytes", &TraceDivergence::numbytes)
+			.def_readonly("expected", &TraceDivergence::expected)
+			.def_readonly("value", &TraceDivergence::value)
+			;
+
+	py::class_<RealtimeConfig>(m, "RealtimeConfig")
+			.def(py::init<>())
+			.def_readwrite("lock_memory", &RealtimeConfig::lock_memory)
+			.def_readwrite("priority", &RealtimeConfig::priority)
+			.def_readwrite("cpu", &RealtimeConfig::cpu)
+			.def_readwrite("spin_ns", &RealtimeConfig::spin_ns)
+			;
+
+	m.def("realtime_setup", &realtime_setup);
+	m.def("sleep_until_ns", &sleep_until_ns);
+
+	py::enum_<SeqOp>(m, "SeqOp")
+			.value("Write", SeqOp::Write)
+			.value("Read", SeqOp::Read)
+			.value("Delay", SeqOp::Delay)
+			.value("Poll", SeqOp::Poll)
+			;
+
+	py::class_<SeqStep>(m, "SeqStep")
+			.def(py::init<>())
+			.def_readwrite("op", &SeqStep::op)
+			.def_readwrite("addr", &SeqStep::addr)
+			.def_readwrite("numbytes", &SeqStep::numbytes)
+			.def_readwrite("mask", &SeqStep::mask)
+			.def_readwrite("value", &SeqStep::value)
+			.def_readwrite("negate", &SeqStep::negate)
+			.def_readwrite("time", &SeqStep::time)
 			;
 
+	py::class_<SeqResult>(m, "SeqResult")
+			.def_readonly("start", &SeqResult::start)
+			.def_readonly("duration", &SeqResult::duration)
+			.def_readonly("value", &SeqResult::value)
+			.def_readonly("ok", &SeqResult::ok)
+			;
+
+	m.def("run_sequence", [](shared_ptr<ITarget> target, const vector<SeqStep>& steps, uint64_t spin_ns) {
+		return run_sequence(target.get(), steps, spin_ns);
+	});
+
+	py::class_<JitterStats>(m, "JitterStats")
+			.def(py::init<>())
+			.def("add", &JitterStats::add)
+			.def_property_readonly("count", &JitterStats::count)
+			.def_property_readonly("min", &JitterStats::min)
+			.def_property_readonly("max", &JitterStats::max)
+			.def_property_readonly("mean", &JitterStats::mean)
+			.def("percentile", &JitterStats::percentile)
+			;
+
+	m.def("replay_trace", &replay_trace, py::arg("filename"), py::arg("target"), py::arg("realtime"),
+	      py::arg("divergence"), py::arg("jitter") = nullptr);
+
 
 	py::class_<MappedRegisterBlock>(m, "MappedRegisterBlock")
 			.def(py::init<const string&, const string&, const string&>())
 			.def(py::init<const string&, uint64_t, const string&, const string&>())
 			.def(py::init<const string&, uint64_t, uint64_t>())
+			.def(py::init<shared_ptr<ITarget>, const string&, const string&>())
 			.def("read", &MappedRegisterBlock::read)
 			.def("read_value", &MappedRegisterBlock::read_value)
 			.def("read32", &MappedRegisterBlock::read32)
@@ -72,8 +206,97 @@ PYBIND11_PLUGIN(pyrwmem) {
 	py::class_<MappedRegister>(m, "MappedRegister")
 			.def("read", &MappedRegister::read)
 			.def("read_value", &MappedRegister::read_value)
+			.def("write", &MappedRegister::write)
+			.def("update_field", (uint64_t (MappedRegister::*)(const string&, uint64_t))&MappedRegister::update_field)
+			.def("update_field", (uint64_t (MappedRegister::*)(uint8_t, uint8_t, uint64_t))&MappedRegister::update_field)
+			.def("wait", (WaitResult (MappedRegister::*)(const string&, uint64_t, uint64_t, bool) const)&MappedRegister::wait,
+			     py::arg("field"), py::arg("value"), py::arg("timeout_ns"), py::arg("negate") = false)
+			.def("wait", (WaitResult (MappedRegister::*)(uint8_t, uint8_t, uint64_t, uint64_t, bool) const)&MappedRegister::wait,
+			     py::arg("high"), py::arg("low"), py::arg("value"), py::arg("timeout_ns"), py::arg("negate") = false)
+			;
+
+	py::class_<WaitResult>(m, "WaitResult")
+			.def_readonly("matched", &WaitResult::matched)
+			.def_readonly("value", &WaitResult::value)
+			.def_readonly("elapsed", &WaitResult::elapsed)
+			;
+
+	m.def("wait_for_value", &wait_for_value);
+
+	py::class_<Sampler>(m, "Sampler")
+			.def(py::init<shared_ptr<ITarget>, const string&, const vector<uint64_t>&, const vector<unsigned>&, uint32_t>())
+			.def("start", &Sampler::start)
+			.def("stop", &Sampler::stop)
+			.def("run", &Sampler::run)
+			.def("sample", &Sampler::sample)
+			.def("set_realtime", &Sampler::set_realtime)
+			.def_property_readonly("jitter", &Sampler::jitter, py::return_value_policy::reference_internal)
+			;
+
+	py::class_<Sample>(m, "Sample")
+			.def_readonly("index", &Sample::index)
+			.def_readonly("timestamp", &Sample::timestamp)
+			.def_readonly("values", &Sample::values)
 			;
 
+	py::class_<SampleReader>(m, "SampleReader")
+			.def(py::init<const string&>())
+			.def_property_readonly("num_regs", &SampleReader::num_regs)
+			.def_property_readonly("interval", &SampleReader::interval)
+			.def_property_readonly("head", &SampleReader::head)
+			.def("reg_addr", &SampleReader::reg_addr)
+			.def("reg_size", &SampleReader::reg_size)
+			.def("read", [](const SampleReader& r, uint64_t index) -> py::object {
+				Sample s;
+				if (!r.read(index, &s))
+					return py::none();
+				return py::cast(s);
+			})
+			.def("latest", [](const SampleReader& r) -> py::object {
+				Sample s;
+				if (!r.latest(&s))
+					return py::none();
+				return py::cast(s);
+			})
+			;
+
+	py::class_<TimeSeriesWriter>(m, "TimeSeriesWriter")
+			.def(py::init<const string&, const vector<uint64_t>&, const vector<unsigned>&>())
+			.def("add", [](TimeSeriesWriter& w, uint64_t timestamp, const vector<uint64_t>& values) {
+				w.add(timestamp, values.data());
+			})
+			.def_property_readonly("num_frames", &TimeSeriesWriter::num_frames)
+			;
+
+	py::class_<SeriesChange>(m, "SeriesChange")
+			.def_readonly("timestamp", &SeriesChange::timestamp)
+			.def_readonly("value", &SeriesChange::value)
+			;
+
+	py::class_<TimeSeriesReader>(m, "TimeSeriesReader")
+			.def(py::init<const string&>())
+			.def_property_readonly("num_regs", &TimeSeriesReader::num_regs)
+			.def_property_readonly("start_time", &TimeSeriesReader::start_time)
+			.def_property_readonly("num_frames", &TimeSeriesReader::num_frames)
+			.def("reg_addr", &TimeSeriesReader::reg_addr)
+			.def("reg_size", &TimeSeriesReader::reg_size)
+			.def("frame_timestamp", &TimeSeriesReader::frame_timestamp)
+			.def("state_at", &TimeSeriesReader::state_at)
+			.def("history", &TimeSeriesReader::history)
+			.def("histories", &TimeSeriesReader::histories)
+			;
+
+	py::enum_<ChecksumType>(m, "ChecksumType")
+			.value("CRC32", ChecksumType::CRC32)
+			.value("CRC32C", ChecksumType::CRC32C)
+			.value("XXH64", ChecksumType::XXH64)
+			;
+
+	m.def("checksum", [](ChecksumType type, py::bytes data) {
+		string s = data;
+		return checksum(type, s.data(), s.size());
+	});
+
 	py::class_<RegisterValue>(m, "RegisterValue")
 			.def("value", &RegisterValue::value)
 			.def("field_value", (uint64_t (RegisterValue::*)(const string&) const)&RegisterValue::field_value)
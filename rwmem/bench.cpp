@@ -0,0 +1,49 @@
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "membench.h"
+#include "helpers.h"
+
+using namespace std;
+
+// Minimum time spent on each test and width
+static const uint64_t bench_min_time = 200000000;
+
+void do_bench(const vector<RwmemOp>& ops, MMapTarget* mm)
+{
+	vector<MemBenchTest> tests;
+
+	for (const string& s : split(rwmem_opts.bench_tests, ',')) {
+		try {
+			tests.push_back(membench_parse_test(s));
+		} catch (const exception& e) {
+			ERR("%s", e.what());
+		}
+	}
+
+	// Machine readable, one line per test and width
+	printf("addr,test,width,bytes,accesses,ns,mbps,ns_per_access\n");
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in benchmark mode");
+
+		uint64_t addr, length;
+		get_op_range(op, &addr, &length);
+
+		vector<MemBenchResult> results;
+
+		try {
+			results = membench(mm, addr, length, tests, bench_min_time);
+		} catch (const exception& e) {
+			ERR("%s", e.what());
+		}
+
+		for (const MemBenchResult& r : results) {
+			printf("0x%" PRIx64 ",%s,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%.3f\n",
+			       addr, membench_test_name(r.test), r.width, r.bytes, r.accesses, r.ns,
+			       (double)r.bytes * 1000 / r.ns, (double)r.ns / r.accesses);
+		}
+
+		fflush(stdout);
+	}
+}
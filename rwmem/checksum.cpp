@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "rwmem.h"
+#include "checksum.h"
+#include "parallelrange.h"
+#include "helpers.h"
+
+using namespace std;
+
+static void print_checksum(uint64_t addr, uint64_t length, ChecksumType type, uint64_t sum)
+{
+	const unsigned sum_chars = type == ChecksumType::XXH64 ? 16 : 8;
+
+	printf("0x%08" PRIx64 "+0x%" PRIx64 " %s 0x%0*" PRIx64 "\n",
+	       addr, length, checksum_name(type), sum_chars, sum);
+}
+
+static void checksum_chunks(uint64_t addr, uint64_t length, const uint8_t* p,
+			    ChecksumType type, uint64_t chunk)
+{
+	// Chunks aligned to pages can be split across threads, and printed as they complete
+	if (chunk % sysconf(_SC_PAGESIZE) == 0 && addr % chunk == 0) {
+		ParallelRange pr(addr, length, chunk, rwmem_opts.threads);
+
+		vector<uint64_t> sums(pr.num_slots());
+
+		auto work = [&](const RangeChunk& c) {
+			sums[c.slot] = checksum(type, p + (c.addr - addr), c.length);
+		};
+
+		auto done = [&](const RangeChunk& c) {
+			print_checksum(c.addr, c.length, type, sums[c.slot]);
+			fflush(stdout);
+		};
+
+		pr.run(false, work, done);
+		return;
+	}
+
+	for (uint64_t offset = 0; offset < length; offset += chunk) {
+		const uint64_t len = min(chunk, length - offset);
+		print_checksum(addr + offset, len, type, checksum(type, p + offset, len));
+	}
+}
+
+void do_checksum(const vector<RwmemOp>& ops, MMapTarget* mm)
+{
+	ChecksumType type;
+
+	try {
+		type = checksum_parse(rwmem_opts.checksum_type);
+	} catch (const exception& e) {
+		ERR("%s", e.what());
+	}
+
+	const uint64_t chunk = rwmem_opts.checksum_chunk;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in checksum mode");
+
+		uint64_t addr, length;
+		get_op_range(op, &addr, &length);
+
+		mm->map(addr, length);
+
+		const uint8_t* p = (const uint8_t*)mm->mapped_ptr(addr, length);
+
+		if (chunk && chunk < length)
+			checksum_chunks(addr, length, p, type, chunk);
+
+		print_checksum(addr, length, type, checksum(type, p, length));
+	}
+}
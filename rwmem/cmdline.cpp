@@ -4,6 +4,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
 
 #include "rwmem.h"
 #include "helpers.h"
@@ -18,6 +19,8 @@ static void usage()
 {
 	fprintf(stderr,
 		"usage: rwmem [options] <address>[:field][=value] ...\n"
+		"       rwmem [options] <address>[:field]==<value> ...\n"
+		"       rwmem [options] <address>[:field]!=<value> ...\n"
 		"\n"
 		"	address			address to access:\n"
 		"				<address>	single address\n"
@@ -29,6 +32,8 @@ static void usage()
 		"				<high>:<low>	bitfield from high to low\n"
 		"\n"
 		"	value			value to be written\n"
+		"				==<value>	wait until equal to value\n"
+		"				!=<value>	wait until not equal to value\n"
 		"\n"
 		"	-h			show this help\n"
 		"	-s <size>[endian]	bit size of the memory access\n"
@@ -36,10 +41,58 @@ static void usage()
 		"	-w <mode>		write mode: w, rw or rwr (default)\n"
 		"	-p <mode>		print mode: q, r or rf (default)\n"
 		"	-R			raw output mode\n"
+		"	--profile[=<n>]		time n reads of each register (default: 1000)\n"
+		"	--profile-write		with --profile, also time writing back the value read\n"
+		"	--sample <name>		sample to a shared memory ring for SampleReaders\n"
+		"	--sample-interval <time> sampling interval (default: 10ms)\n"
+		"	--bench[=<tests>]	benchmark the given ranges, comma separated tests:\n"
+		"				read, write, copy, latency (default: read)\n"
+		"				write, copy and latency overwrite the ranges\n"
+		"	--search <value>[&<mask>] find the value in the given ranges\n"
+		"	--search-unaligned	with --search, look at every byte, not every -s bytes\n"
+		"	--checksum[=<type>]	checksum the given ranges: crc32 (default), crc32c, xxh64\n"
+		"	--checksum-chunk <n>	with --checksum, also checksum each n bytes\n"
+		"	--threads <n>		worker threads for large mmap-mode range operations\n"
+		"				(default: one per CPU for search and checksum, else 1)\n"
+		"	--rt[=<prio>]		real-time mode: lock memory, busy-wait the delays of --watch,\n"
+		"				--sample and --replay and report their jitter; with prio,\n"
+		"				also run at that SCHED_FIFO priority\n"
+		"	--cpu <n>		run on CPU n\n"
 		"	--list			list-mode, do not read or write\n"
 		"	--mmap <file>		mmap-mode, file to open (default: /dev/mem)\n"
+		"	--cached		mmap-mode, map cached (no O_SYNC)\n"
+		"	--flush			mmap-mode, msync the written pages of a file before exit\n"
 		"	--i2c <bus>:<addr>	i2c-mode, device bus and address\n"
+		"	--i2c-page <n>		i2c-mode, write up to n bytes per transfer with --load\n"
+		"	--i2c-burst[=<n>]	i2c-mode, read consecutive registers with transfers of up\n"
+		"				to n bytes (default: 8192)\n"
+		"	--i2c-cache[=<mode>]	i2c-mode, cache register values, write 'through' (default)\n"
+		"				or 'back' at exit\n"
+		"	--volatile <regs>	with --i2c-cache, comma separated registers never cached\n"
+		"	--sim[=<file>]		sim-mode, simulate the register file in memory\n"
+		"	--sim-latency <r>[,<w>]	sim-mode read and write access latency in ns\n"
+		"	--dumpfile <file>	dump-mode, read from a compressed dump\n"
+		"	--pid <pid>[:<base>]	process-mode, memory of a process, at base (default: 0)\n"
+		"	--cosim <name>		cosim-mode, requests to a model on a shared memory ring\n"
+		"	--cosim-echo <name>	serve a ring with the reference echo model until killed\n"
 		"	--regs <file>		register description file\n"
+		"	--trace <file>		record all accesses to a binary trace file\n"
+		"	--replay <file>		replay a trace against the target\n"
+		"	--replay-fast		replay at maximum speed instead of recorded timing\n"
+		"	--snapshot <file>	save the values of the given registers to a file\n"
+		"	--dump <file>		write a compressed dump of the given ranges ('-' for stdout)\n"
+		"	--load <file>		write raw data from a file to the given ranges ('-' for stdin)\n"
+		"	--copy-to <addr>	copy the given ranges to addr of the destination target\n"
+		"	--to-mmap <file>	with --copy-to, mmap destination (default: the mmap target)\n"
+		"	--to-i2c <bus>:<addr>	with --copy-to, i2c destination\n"
+		"	--to-size <size>[endian] with --copy-to, destination access size (default: -s)\n"
+		"	--verify <file>		compare registers against expected values in a file\n"
+		"	--seq <file>		run a sequence of timed writes, reads, delays and polls\n"
+		"	--timeout <time>	timeout for == and != waits (default: 1s)\n"
+		"	--watch <interval>	re-read periodically and print changes (e.g. 100us, 10ms, 1s)\n"
+		"	--record <file>		with --watch, record the values to a time-series file\n"
+		"	--history <file>	print the register changes in a time-series file\n"
+		"	--at <time>		with --history, print the values at the time instead\n"
 		"	--ignore-base		ignore base from register desc file\n"
 		);
 
@@ -52,16 +105,22 @@ void parse_arg(string str, RwmemOptsArg *arg)
 
 	// extract value
 
-	idx = str.find('=');
-
-	if (idx != string::npos) {
+	if ((idx = str.find("==")) != string::npos) {
+		arg->wait = WaitCond::Equal;
+		arg->value = str.substr(idx + 2);
+		str.resize(idx);
+	} else if ((idx = str.find("!=")) != string::npos) {
+		arg->wait = WaitCond::NotEqual;
+		arg->value = str.substr(idx + 2);
+		str.resize(idx);
+	} else if ((idx = str.find('=')) != string::npos) {
 		arg->value = str.substr(idx + 1);
 		str.resize(idx);
-
-		if (arg->value.empty())
-			usage();
 	}
 
+	if (idx != string::npos && arg->value.empty())
+		usage();
+
 	// extract field
 
 	idx = str.find(':');
@@ -200,10 +259,260 @@ void parse_cmdline(int argc, char **argv)
 			rwmem_opts.i2c_target = s;
 			rwmem_opts.target_type = TargetType::I2C;
 		}),
+		Option("|sim?", [](string s)
+		{
+			rwmem_opts.sim_config = s;
+			rwmem_opts.target_type = TargetType::Sim;
+		}),
+		Option("|dumpfile=", [](string s)
+		{
+			rwmem_opts.dump_target = s;
+			rwmem_opts.target_type = TargetType::Dump;
+		}),
+		Option("|i2c-page=", [](string s)
+		{
+			uint64_t v;
+			int r = parse_u64(s, &v);
+			ERR_ON(r || v > 0xffff, "Invalid i2c page size '%s'", s.c_str());
+			rwmem_opts.i2c_page_size = v;
+		}),
+		Option("|i2c-burst?", [](string s)
+		{
+			// The default is the i2c-dev limit for a message
+			uint64_t v = 8192;
+
+			if (!s.empty()) {
+				int r = parse_u64(s, &v);
+				ERR_ON(r || v == 0 || v > 8192, "Invalid i2c burst length '%s'", s.c_str());
+			}
+
+			rwmem_opts.i2c_burst_len = v;
+		}),
+		Option("|i2c-cache?", [](string s)
+		{
+			ERR_ON(!s.empty() && s != "through" && s != "back", "Invalid i2c cache mode '%s'", s.c_str());
+
+			rwmem_opts.i2c_cache = true;
+			rwmem_opts.i2c_cache_write_back = s == "back";
+		}),
+		Option("|volatile=", [](string s)
+		{
+			for (const string& reg : split(s, ','))
+				rwmem_opts.volatile_regs.push_back(reg);
+		}),
+		Option("|pid=", [](string s)
+		{
+			rwmem_opts.pid_target = s;
+			rwmem_opts.target_type = TargetType::Process;
+		}),
+		Option("|cosim=", [](string s)
+		{
+			rwmem_opts.cosim_target = s;
+			rwmem_opts.target_type = TargetType::CoSim;
+		}),
+		Option("|cosim-echo=", [](string s)
+		{
+			rwmem_opts.cosim_echo = s;
+		}),
+		Option("|sim-latency=", [](string s)
+		{
+			vector<string> strs = split(s, ',');
+			ERR_ON(strs.empty() || strs.size() > 2, "Invalid sim latency '%s'", s.c_str());
+
+			uint64_t rl, wl;
+
+			int r = parse_u64(strs[0], &rl);
+			ERR_ON(r, "Invalid sim latency '%s'", s.c_str());
+
+			wl = rl;
+
+			if (strs.size() > 1) {
+				r = parse_u64(strs[1], &wl);
+				ERR_ON(r, "Invalid sim latency '%s'", s.c_str());
+			}
+
+			rwmem_opts.sim_read_latency = rl;
+			rwmem_opts.sim_write_latency = wl;
+		}),
 		Option("|regs=", [](string s)
 		{
 			rwmem_opts.regfile = s;
 		}),
+		Option("|trace=", [](string s)
+		{
+			rwmem_opts.trace_file = s;
+		}),
+		Option("|replay=", [](string s)
+		{
+			rwmem_opts.replay_file = s;
+		}),
+		Option("|replay-fast", []()
+		{
+			rwmem_opts.replay_fast = true;
+		}),
+		Option("|snapshot=", [](string s)
+		{
+			rwmem_opts.snapshot_file = s;
+		}),
+		Option("|dump=", [](string s)
+		{
+			rwmem_opts.dump_file = s;
+		}),
+		Option("|load=", [](string s)
+		{
+			rwmem_opts.load_file = s;
+		}),
+		Option("|copy-to=", [](string s)
+		{
+			int r = parse_u64(s, &rwmem_opts.copy_addr);
+			ERR_ON(r, "Invalid copy address '%s'", s.c_str());
+			rwmem_opts.copy = true;
+		}),
+		Option("|to-mmap=", [](string s)
+		{
+			rwmem_opts.copy_mmap_target = s;
+		}),
+		Option("|to-i2c=", [](string s)
+		{
+			rwmem_opts.copy_i2c_target = s;
+		}),
+		Option("|to-size=", [](string s)
+		{
+			Endianness endianness;
+			uint32_t size;
+
+			parse_size_endian(s, &size, &endianness);
+
+			ERR_ON(size != 8 && size != 16 && size != 32 && size != 64,
+			"Invalid size '%s'", s.c_str());
+
+			rwmem_opts.copy_data_size = size / 8;
+			rwmem_opts.copy_data_endianness = endianness;
+		}),
+		Option("|verify=", [](string s)
+		{
+			rwmem_opts.verify_file = s;
+		}),
+		Option("|seq=", [](string s)
+		{
+			rwmem_opts.seq_file = s;
+		}),
+		Option("|timeout=", [](string s)
+		{
+			int r = parse_duration(s, &rwmem_opts.wait_timeout);
+			ERR_ON(r, "Invalid timeout '%s'", s.c_str());
+		}),
+		Option("|watch=", [](string s)
+		{
+			int r = parse_duration(s, &rwmem_opts.watch_interval);
+			ERR_ON(r || rwmem_opts.watch_interval == 0, "Invalid watch interval '%s'", s.c_str());
+		}),
+		Option("|record=", [](string s)
+		{
+			rwmem_opts.record_file = s;
+		}),
+		Option("|history=", [](string s)
+		{
+			rwmem_opts.history_file = s;
+		}),
+		Option("|at=", [](string s)
+		{
+			int r = parse_duration(s, &rwmem_opts.history_at);
+			ERR_ON(r, "Invalid time '%s'", s.c_str());
+
+			rwmem_opts.history_at_valid = true;
+		}),
+		Option("|profile?", [](string s)
+		{
+			uint64_t n = 1000;
+
+			if (!s.empty()) {
+				int r = parse_u64(s, &n);
+				ERR_ON(r || n == 0, "Invalid profile iterations '%s'", s.c_str());
+			}
+
+			rwmem_opts.profile_iterations = n;
+		}),
+		Option("|profile-write", []()
+		{
+			rwmem_opts.profile_write = true;
+		}),
+		Option("|sample=", [](string s)
+		{
+			rwmem_opts.sample_name = s[0] == '/' ? s : "/" + s;
+		}),
+		Option("|sample-interval=", [](string s)
+		{
+			int r = parse_duration(s, &rwmem_opts.sample_interval);
+			ERR_ON(r || rwmem_opts.sample_interval == 0, "Invalid sample interval '%s'", s.c_str());
+		}),
+		Option("|bench?", [](string s)
+		{
+			// The other tests overwrite the range, so they have to be asked for
+			rwmem_opts.bench_tests = s.empty() ? "read" : s;
+		}),
+		Option("|search=", [](string s)
+		{
+			vector<string> strs = split(s, '&');
+			ERR_ON(strs.empty() || strs.size() > 2, "Invalid search value '%s'", s.c_str());
+
+			int r = parse_u64(strs[0], &rwmem_opts.search_value);
+			ERR_ON(r, "Invalid search value '%s'", s.c_str());
+
+			if (strs.size() == 2) {
+				r = parse_u64(strs[1], &rwmem_opts.search_mask);
+				ERR_ON(r, "Invalid search mask '%s'", s.c_str());
+			}
+
+			rwmem_opts.search = true;
+		}),
+		Option("|search-unaligned", []()
+		{
+			rwmem_opts.search_unaligned = true;
+		}),
+		Option("|checksum?", [](string s)
+		{
+			rwmem_opts.checksum_type = s.empty() ? "crc32" : s;
+		}),
+		Option("|checksum-chunk=", [](string s)
+		{
+			int r = parse_u64(s, &rwmem_opts.checksum_chunk);
+			ERR_ON(r || rwmem_opts.checksum_chunk == 0, "Invalid checksum chunk size '%s'", s.c_str());
+		}),
+		Option("|threads=", [](string s)
+		{
+			uint64_t n;
+			int r = parse_u64(s, &n);
+			ERR_ON(r || n == 0, "Invalid thread count '%s'", s.c_str());
+
+			rwmem_opts.threads = n;
+		}),
+		Option("|rt?", [](string s)
+		{
+			rwmem_opts.realtime = true;
+
+			if (!s.empty()) {
+				uint64_t v;
+				int r = parse_u64(s, &v);
+				ERR_ON(r || v < 1 || v > 99, "Invalid real-time priority '%s'", s.c_str());
+				rwmem_opts.rt_priority = v;
+			}
+		}),
+		Option("|cpu=", [](string s)
+		{
+			uint64_t v;
+			int r = parse_u64(s, &v);
+			ERR_ON(r || v >= CPU_SETSIZE, "Invalid CPU '%s'", s.c_str());
+			rwmem_opts.rt_cpu = v;
+		}),
+		Option("|cached", []()
+		{
+			rwmem_opts.mmap_cached = true;
+		}),
+		Option("|flush", []()
+		{
+			rwmem_opts.mmap_flush = true;
+		}),
 		Option("|list", [](string s)
 		{
 			rwmem_opts.show_list = true;
@@ -233,7 +542,10 @@ void parse_cmdline(int argc, char **argv)
 
 	const vector<string> params = optionset.params();
 
-	if (!rwmem_opts.show_list && params.empty())
+	if (!rwmem_opts.show_list && rwmem_opts.replay_file.empty() &&
+	    rwmem_opts.verify_file.empty() && rwmem_opts.history_file.empty() &&
+	    rwmem_opts.seq_file.empty() &&
+	    rwmem_opts.cosim_echo.empty() && params.empty())
 		usage();
 
 	rwmem_opts.args = params;
@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "mmaptarget.h"
+#include "targetcopy.h"
+#include "helpers.h"
+
+using namespace std;
+
+void do_copy(const vector<RwmemOp>& ops, ITarget* mm)
+{
+	const unsigned src_size = rwmem_opts.data_size;
+	const unsigned dst_size = rwmem_opts.copy_data_size ? rwmem_opts.copy_data_size : src_size;
+
+	Endianness dst_endianness = rwmem_opts.copy_data_endianness;
+	if (dst_endianness == Endianness::Default)
+		dst_endianness = rwmem_opts.data_endianness;
+
+	unique_ptr<ITarget> dst;
+	bool same_file = false;
+
+	if (!rwmem_opts.copy_i2c_target.empty()) {
+		dst = create_i2c_target(rwmem_opts.copy_i2c_target, dst_endianness);
+	} else {
+		string file = rwmem_opts.copy_mmap_target;
+
+		if (file.empty()) {
+			ERR_ON(rwmem_opts.target_type != TargetType::MMap,
+			       "Copy needs a destination, --to-mmap or --to-i2c");
+
+			file = rwmem_opts.mmap_target;
+		}
+
+		same_file = rwmem_opts.target_type == TargetType::MMap && file == rwmem_opts.mmap_target;
+
+		auto mmt = make_unique<MMapTarget>(file, dst_endianness, rwmem_opts.mmap_cached);
+		mmt->set_flush_on_unmap(rwmem_opts.mmap_flush);
+
+		dst = move(mmt);
+	}
+
+	uint64_t dst_addr = rwmem_opts.copy_addr;
+	uint64_t total = 0;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in copy mode");
+
+		uint64_t addr, length;
+		get_op_range(op, &addr, &length);
+
+		ERR_ON(addr % src_size || length % src_size || dst_addr % dst_size || length % dst_size,
+		       "Copy range not aligned to the access size");
+
+		ERR_ON(same_file && addr < dst_addr + length && dst_addr < addr + length,
+		       "Copy source and destination overlap");
+
+		mm->map(addr, length);
+		dst->map(dst_addr, length);
+
+		target_copy(CopyEndpoint { dst.get(), dst_addr, dst_size, dst_endianness },
+			    CopyEndpoint { mm, addr, src_size, rwmem_opts.data_endianness },
+			    length, range_threads());
+
+		dst_addr += length;
+		total += length;
+	}
+
+	vprint("%" PRIu64 " bytes copied\n", total);
+}
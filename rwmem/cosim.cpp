@@ -0,0 +1,58 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <signal.h>
+#include <unordered_map>
+
+#include "rwmem.h"
+#include "cosim.h"
+#include "helpers.h"
+
+using namespace std;
+
+static const uint32_t cosim_ring_slots = 256;
+
+static CoSimModel* s_model;
+
+static void cosim_sig_handler(int sig)
+{
+	s_model->stop();
+}
+
+/*
+ * The reference model: a sparse register space where a read returns the last
+ * value written to the address, or 0. Accesses of other sizes than 1, 2, 4
+ * or 8 bytes fail, so that clients can test their error handling too.
+ */
+void do_cosim_echo(const string& name)
+{
+	CoSimModel model(name, cosim_ring_slots);
+	unordered_map<uint64_t, uint64_t> regs;
+
+	vprint("Serving co-sim ring '%s'\n", name.c_str());
+
+	// Stop cleanly on signals so that the shm segment is removed
+	s_model = &model;
+
+	struct sigaction sa { };
+	sa.sa_handler = cosim_sig_handler;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	model.serve([&regs](CoSimRequest& req) {
+		if (req.size != 1 && req.size != 2 && req.size != 4 && req.size != 8)
+			return false;
+
+		const uint64_t mask = GENMASK(req.size * 8 - 1, 0);
+
+		if (req.op == (uint8_t)CoSimOp::Write) {
+			regs[req.addr] = req.value & mask;
+		} else {
+			auto it = regs.find(req.addr);
+			req.value = it == regs.end() ? 0 : it->second & mask;
+		}
+
+		return true;
+	});
+
+	vprint("Served %" PRIu64 " requests\n", model.num_served());
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "dumpfile.h"
+#include "parallelrange.h"
+#include "byteorder.h"
+#include "helpers.h"
+
+using namespace std;
+
+static const uint32_t dump_frame_size = 64 * 1024;
+
+void do_dump(const string& filename, const vector<RwmemOp>& ops, ITarget* mm)
+{
+	const unsigned size = rwmem_opts.data_size;
+
+	DumpWriter writer(filename, dump_frame_size);
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in dump mode");
+
+		uint64_t addr, length;
+		get_op_range(op, &addr, &length);
+
+		ERR_ON(addr % size || length % size, "Dump range not aligned to the access size");
+
+		mm->map(addr, length);
+
+		ParallelRange pr(addr, length, dump_frame_size, range_threads());
+
+		vector<vector<uint8_t>> bufs(pr.num_slots());
+		vector<DumpFrame> frames(pr.num_slots());
+
+		auto work = [&](const RangeChunk& c) {
+			vector<uint8_t>& buf = bufs[c.slot];
+			buf.resize(c.length);
+
+			mm->read_block(c.addr, size, c.length / size, buf.data());
+			convert_byte_order(buf.data(), buf.data(), c.length / size, size,
+					   rwmem_opts.data_endianness);
+
+			DumpWriter::encode(c.addr, buf.data(), c.length, frames[c.slot]);
+		};
+
+		auto done = [&](const RangeChunk& c) {
+			writer.write(frames[c.slot]);
+		};
+
+		pr.run(true, work, done);
+	}
+
+	writer.close();
+
+	vprint("%" PRIu64 " bytes dumped, compressed to %" PRIu64 " bytes\n",
+	       writer.bytes_in(), writer.bytes_out());
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "timeseries.h"
+#include "helpers.h"
+
+using namespace std;
+
+static void print_reg(const TimeSeriesReader& ts, uint32_t idx, const RegisterFileData* rfd)
+{
+	const uint64_t addr = ts.reg_addr(idx);
+
+	if (rfd) {
+		const RegisterBlockData* rbd;
+		const RegisterData* rd = rfd->find_register(addr, &rbd);
+
+		if (rd) {
+			string name = sformat("%s.%s", rbd->name(rfd), rd->name(rfd));
+			printf("%-30s ", name.c_str());
+		}
+	}
+
+	printf("0x%08" PRIx64, addr);
+}
+
+void do_history(const string& filename, const RegisterFile* regfile)
+{
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	unique_ptr<TimeSeriesReader> ts;
+
+	try {
+		ts = make_unique<TimeSeriesReader>(filename);
+	} catch (const exception& e) {
+		ERR("%s: %s", filename.c_str(), e.what());
+	}
+
+	if (rwmem_opts.history_at_valid) {
+		vector<uint64_t> state;
+
+		try {
+			state = ts->state_at(rwmem_opts.history_at);
+		} catch (const exception& e) {
+			ERR("%s", e.what());
+		}
+
+		for (uint32_t i = 0; i < ts->num_regs(); ++i) {
+			print_reg(*ts, i, rfd);
+			printf(" = 0x%0*" PRIx64 "\n", ts->reg_size(i) * 2, state[i]);
+		}
+
+		return;
+	}
+
+	vector<vector<SeriesChange>> histories;
+
+	try {
+		histories = ts->histories();
+	} catch (const exception& e) {
+		ERR("%s: %s", filename.c_str(), e.what());
+	}
+
+	for (uint32_t i = 0; i < ts->num_regs(); ++i) {
+		print_reg(*ts, i, rfd);
+		printf("\n");
+
+		for (const SeriesChange& c : histories[i])
+			printf("  [%4" PRIu64 ".%09" PRIu64 "] 0x%0*" PRIx64 "\n",
+			       c.timestamp / 1000000000, c.timestamp % 1000000000,
+			       ts->reg_size(i) * 2, c.value);
+	}
+
+	printf("%u registers, %zu frames\n", ts->num_regs(), ts->num_frames());
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rwmem.h"
+#include "mmaptarget.h"
+#include "byteorder.h"
+#include "helpers.h"
+
+using namespace std;
+
+static const size_t load_chunk_size = 64 * 1024;
+
+// Read until 'len' bytes or the end of the input, returns the bytes read
+static size_t read_full(int fd, uint8_t* buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (pos < len) {
+		ssize_t l = read(fd, buf + pos, len - pos);
+		ERR_ON_ERRNO(l < 0, "Failed to read load input");
+
+		if (l == 0)
+			break;
+
+		pos += l;
+	}
+
+	return pos;
+}
+
+void do_load(const string& filename, const vector<RwmemOp>& ops, ITarget* mm)
+{
+	const unsigned size = rwmem_opts.data_size;
+
+	int fd = STDIN_FILENO;
+
+	if (filename != "-") {
+		fd = open(filename.c_str(), O_RDONLY);
+		ERR_ON_ERRNO(fd < 0, "Failed to open load file '%s'", filename.c_str());
+	}
+
+	// Not set when tracing, so that each access is recorded
+	MMapTarget* mmt = dynamic_cast<MMapTarget*>(mm);
+
+	uint64_t total = 0;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in load mode");
+
+		uint64_t addr, length;
+		get_op_range(op, &addr, &length);
+
+		ERR_ON(addr % size || length % size, "Load range not aligned to the access size");
+
+		mm->map(addr, length);
+
+		uint64_t loaded;
+
+		if (mmt && mmt->is_memory()) {
+			// Plain memory is filled straight from the input and converted in place
+			uint8_t* p = (uint8_t*)mmt->mapped_ptr(addr, length);
+
+			loaded = read_full(fd, p, length);
+			convert_byte_order(p, p, loaded / size, size, rwmem_opts.data_endianness);
+			mmt->mark_dirty(addr, loaded);
+		} else {
+			vector<uint8_t> buf(min(length, (uint64_t)load_chunk_size));
+
+			for (loaded = 0; loaded < length; ) {
+				const size_t n = min(length - loaded, (uint64_t)buf.size());
+				const size_t l = read_full(fd, buf.data(), n);
+
+				mm->write_block(addr + loaded, size, l / size, buf.data());
+				loaded += l;
+
+				if (l != n)
+					break;
+			}
+		}
+
+		total += loaded;
+
+		ERR_ON(loaded != length, "Input ended %" PRIu64 " bytes into the range %#" PRIx64 "+%#" PRIx64,
+		       loaded, addr, length);
+	}
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	vprint("%" PRIu64 " bytes loaded\n", total);
+}
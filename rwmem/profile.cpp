@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <stdio.h>
+#include <time.h>
+
+#include "rwmem.h"
+#include "reglist.h"
+#include "helpers.h"
+
+using namespace std;
+
+// Registers with a median latency this many times the overall median are flagged
+static const unsigned outlier_factor = 4;
+
+struct LatencyStats
+{
+	uint64_t min;
+	uint64_t median;
+	uint64_t p99;
+	uint64_t max;
+};
+
+static inline uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The cost of reading the clock, subtracted from all samples
+static uint64_t clock_overhead()
+{
+	uint64_t best = ~0ULL;
+
+	for (unsigned i = 0; i < 1000; ++i) {
+		uint64_t t0 = now_ns();
+		uint64_t t1 = now_ns();
+		best = min(best, t1 - t0);
+	}
+
+	return best;
+}
+
+static LatencyStats calc_stats(vector<uint64_t>& samples)
+{
+	sort(samples.begin(), samples.end());
+
+	const size_t n = samples.size();
+
+	return LatencyStats {
+		samples[0],
+		samples[n / 2],
+		samples[min(n - 1, n * 99 / 100)],
+		samples[n - 1],
+	};
+}
+
+static void print_stats(const char* what, const LatencyStats& st, bool outlier)
+{
+	printf(" %s min %6" PRIu64 " med %6" PRIu64 " p99 %6" PRIu64 " max %6" PRIu64 " ns%s",
+	       what, st.min, st.median, st.p99, st.max, outlier ? " !" : "");
+}
+
+void do_profile(const vector<RwmemOp>& ops, const RegisterFile* regfile, ITarget* mm)
+{
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	RegList regs;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in profile mode");
+		reglist_add_op(regs, op, rfd, 0, ~0ULL);
+	}
+
+	reglist_prepare(regs);
+
+	const unsigned iters = rwmem_opts.profile_iterations;
+	const uint64_t overhead = clock_overhead();
+
+	vector<LatencyStats> read_stats(regs.size());
+	vector<LatencyStats> write_stats(regs.size());
+	vector<uint64_t> samples(iters);
+
+	for (const RegBatch& b : regs.batches) {
+		mm->map(b.map_offset, b.map_length);
+
+		for (size_t i = b.first; i < b.first + b.count; ++i) {
+			const uint64_t addr = regs.addrs[i];
+			const unsigned size = regs.sizes[i];
+
+			// warm up
+			uint64_t v = mm->read(addr, size);
+
+			for (unsigned n = 0; n < iters; ++n) {
+				uint64_t t0 = now_ns();
+				mm->read(addr, size);
+				uint64_t t1 = now_ns();
+				samples[n] = t1 - t0 > overhead ? t1 - t0 - overhead : 0;
+			}
+
+			read_stats[i] = calc_stats(samples);
+
+			if (!rwmem_opts.profile_write)
+				continue;
+
+			// write back the value that was read
+			for (unsigned n = 0; n < iters; ++n) {
+				uint64_t t0 = now_ns();
+				mm->write(addr, size, v);
+				uint64_t t1 = now_ns();
+				samples[n] = t1 - t0 > overhead ? t1 - t0 - overhead : 0;
+			}
+
+			write_stats[i] = calc_stats(samples);
+		}
+	}
+
+	// Median of the register medians
+	vector<uint64_t> medians;
+	for (const LatencyStats& st : read_stats)
+		medians.push_back(st.median);
+	const uint64_t read_median = calc_stats(medians).median;
+
+	medians.clear();
+	for (const LatencyStats& st : write_stats)
+		medians.push_back(st.median);
+	const uint64_t write_median = calc_stats(medians).median;
+
+	unsigned num_outliers = 0;
+
+	for (size_t i = 0; i < regs.size(); ++i) {
+		const RegisterData* rd = regs.rds[i];
+
+		string name;
+		if (rd)
+			name = sformat("%s.%s", regs.rbds[i]->name(rfd), rd->name(rfd));
+
+		printf("%-30s 0x%08" PRIx64, name.c_str(), regs.paddrs[i]);
+
+		bool outlier = read_stats[i].median > max(read_median, (uint64_t)1) * outlier_factor;
+		print_stats("read", read_stats[i], outlier);
+		num_outliers += outlier;
+
+		if (rwmem_opts.profile_write) {
+			outlier = write_stats[i].median > max(write_median, (uint64_t)1) * outlier_factor;
+			print_stats("write", write_stats[i], outlier);
+			num_outliers += outlier;
+		}
+
+		printf("\n");
+	}
+
+	printf("%zu registers, %u iterations, median read %" PRIu64 " ns",
+	       regs.size(), iters, read_median);
+
+	if (rwmem_opts.profile_write)
+		printf(", median write %" PRIu64 " ns", write_median);
+
+	printf(", %u outliers (!)\n", num_outliers);
+}
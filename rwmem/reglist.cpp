@@ -0,0 +1,129 @@
+#include <algorithm>
+
+#include "reglist.h"
+#include "helpers.h"
+#include "parallelrange.h"
+
+using namespace std;
+
+// Registers further apart than this are mapped and read in separate batches
+static const uint64_t max_batch_span = 16 * 1024 * 1024;
+
+void RegList::add(uint64_t addr, uint64_t paddr, unsigned size,
+		  const RegisterBlockData* rbd, const RegisterData* rd,
+		  uint64_t expected_value, uint64_t mask)
+{
+	addrs.push_back(addr);
+	sizes.push_back(size);
+	paddrs.push_back(paddr);
+	rbds.push_back(rbd);
+	rds.push_back(rd);
+	expected.push_back(expected_value);
+	masks.push_back(mask);
+}
+
+void reglist_add_op(RegList& regs, const RwmemOp& op, const RegisterFileData* rfd,
+		    uint64_t expected, uint64_t mask)
+{
+	if (op.rbd) {
+		const uint64_t access_base = rwmem_opts.ignore_base ? 0 : op.rbd->offset();
+
+		vector<const RegisterData*> rds = op.rds;
+
+		if (rds.empty()) {
+			for (unsigned ridx = 0; ridx < op.rbd->num_regs(); ++ridx)
+				rds.push_back(op.rbd->at(rfd, ridx));
+		}
+
+		for (const RegisterData* rd : rds) {
+			unsigned size = rwmem_opts.user_data_size ? rwmem_opts.data_size : rd->size();
+
+			regs.add(access_base + rd->offset(), op.rbd->offset() + rd->offset(), size,
+				 op.rbd, rd, expected, mask & GENMASK(size * 8 - 1, 0));
+		}
+	} else {
+		const unsigned size = rwmem_opts.data_size;
+
+		for (uint64_t offset = 0; offset < op.range; offset += size) {
+			const uint64_t addr = op.reg_offset + offset;
+			const RegisterBlockData* rbd = nullptr;
+			const RegisterData* rd = nullptr;
+
+			if (rfd && !rwmem_opts.ignore_base)
+				rd = rfd->find_register(addr, &rbd);
+
+			regs.add(addr, addr, size, rd ? rbd : nullptr, rd, expected, mask);
+		}
+	}
+}
+
+void reglist_prepare(RegList& regs)
+{
+	vector<size_t> idx(regs.size());
+	for (size_t i = 0; i < idx.size(); ++i)
+		idx[i] = i;
+
+	stable_sort(idx.begin(), idx.end(),
+		    [&regs](size_t a, size_t b) { return regs.addrs[a] < regs.addrs[b]; });
+
+	RegList sorted;
+
+	for (size_t i : idx)
+		sorted.add(regs.addrs[i], regs.paddrs[i], regs.sizes[i], regs.rbds[i], regs.rds[i],
+			   regs.expected[i], regs.masks[i]);
+
+	sorted.values.resize(sorted.size());
+
+	size_t i = 0;
+
+	while (i < sorted.size()) {
+		const uint64_t start = sorted.addrs[i];
+		uint64_t end = start + sorted.sizes[i];
+
+		size_t j = i + 1;
+
+		while (j < sorted.size() && sorted.addrs[j] + sorted.sizes[j] - start <= max_batch_span) {
+			end = max(end, sorted.addrs[j] + sorted.sizes[j]);
+			j++;
+		}
+
+		sorted.batches.push_back(RegBatch { i, j - i, start, end - start });
+
+		i = j;
+	}
+
+	regs = move(sorted);
+}
+
+static void reglist_read_parallel(RegList& regs, const RegBatch& b, ITarget* mm, unsigned num_threads)
+{
+	ParallelRange pr(b.map_offset, b.map_length, range_chunk_size, num_threads);
+
+	const auto first = regs.addrs.begin() + b.first;
+	const auto last = first + b.count;
+
+	// Each chunk reads the registers starting in it
+	auto work = [&](const RangeChunk& c) {
+		const size_t start = lower_bound(first, last, c.addr) - regs.addrs.begin();
+		const size_t end = lower_bound(first, last, c.addr + c.length) - regs.addrs.begin();
+
+		mm->read_batch(&regs.addrs[start], &regs.sizes[start], &regs.values[start], end - start);
+	};
+
+	pr.run(false, work, [](const RangeChunk&) { });
+}
+
+void reglist_read(RegList& regs, ITarget* mm, unsigned num_threads)
+{
+	for (const RegBatch& b : regs.batches) {
+		if (!regs.mapped)
+			mm->map(b.map_offset, b.map_length);
+
+		if (num_threads > 1 && b.map_length > range_chunk_size)
+			reglist_read_parallel(regs, b, mm, num_threads);
+		else
+			mm->read_batch(&regs.addrs[b.first], &regs.sizes[b.first], &regs.values[b.first], b.count);
+	}
+
+	regs.mapped = regs.batches.size() == 1;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "rwmem.h"
+
+struct RegBatch
+{
+	size_t first;
+	size_t count;
+
+	uint64_t map_offset;
+	uint64_t map_length;
+};
+
+// A flat list of registers, read from the target in batches
+struct RegList
+{
+	// Target accesses, in the form used by ITarget::read_batch()
+	std::vector<uint64_t> addrs;
+	std::vector<unsigned> sizes;
+	std::vector<uint64_t> values;
+
+	std::vector<uint64_t> expected;
+	std::vector<uint64_t> masks;
+
+	// For printing
+	std::vector<uint64_t> paddrs;
+	std::vector<const RegisterBlockData*> rbds;
+	std::vector<const RegisterData*> rds;
+
+	// Set by reglist_prepare()
+	std::vector<RegBatch> batches;
+	bool mapped = false;
+
+	size_t size() const { return addrs.size(); }
+
+	void add(uint64_t addr, uint64_t paddr, unsigned size,
+		 const RegisterBlockData* rbd, const RegisterData* rd,
+		 uint64_t expected_value, uint64_t mask);
+};
+
+void reglist_add_op(RegList& regs, const RwmemOp& op, const RegisterFileData* rfd,
+		    uint64_t expected, uint64_t mask);
+
+// Sort the registers by address and split them into batches
+void reglist_prepare(RegList& regs);
+
+// Read all registers into 'values'. A single batch is mapped only once.
+// With num_threads > 1, the batches are read in chunks by worker threads.
+void reglist_read(RegList& regs, ITarget* mm, unsigned num_threads = 1);
@@ -17,24 +17,30 @@
  * MA  02110-1301, USA.
  */
 
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <unordered_map>
 
 #include "rwmem.h"
 #include "helpers.h"
 #include "regs.h"
 #include "i2ctarget.h"
+#include "cachedtarget.h"
+#include "simtarget.h"
+#include "tracetarget.h"
+#include "dumpfile.h"
+#include "processtarget.h"
+#include "cosim.h"
+#include "wait.h"
+#include "parallelrange.h"
+#include "reglist.h"
 
 #include <fnmatch.h>
 
 using namespace std;
 
-#define printq(format...) \
-	do { \
-	if (rwmem_opts.print_mode != PrintMode::Quiet) \
-	printf(format); \
-	} while(0)
-
 static vector<const RegisterData*> match_registers(const RegisterFileData* rfd, const RegisterBlockData* rbd, const string& pattern)
 {
 	vector<const RegisterData*> matches;
@@ -205,7 +211,18 @@ static void readwriteprint(const RwmemOp& op,
 
 	oldval = userval = newval = 0;
 
-	if (rwmem_opts.write_mode != WriteMode::Write) {
+	// On shared memory the field is updated atomically, and the old value
+	// is the one the update replaced
+	const bool atomic = op.value_valid && rwmem_opts.write_mode != WriteMode::Write &&
+			    mm->atomic_updates();
+
+	if (atomic) {
+		oldval = mm->update_bits(op_addr, width, GENMASK(op.high, op.low), op.value << op.low);
+
+		printq("= 0x%0*" PRIx64 " ", formatting.value_chars, oldval);
+
+		newval = oldval;
+	} else if (rwmem_opts.write_mode != WriteMode::Write) {
 		oldval = mm->read(op_addr, width);
 
 		printq("= 0x%0*" PRIx64 " ", formatting.value_chars, oldval);
@@ -224,7 +241,8 @@ static void readwriteprint(const RwmemOp& op,
 
 		fflush(stdout);
 
-		mm->write(op_addr, width, v);
+		if (!atomic)
+			mm->write(op_addr, width, v);
 
 		newval = v;
 		userval = v;
@@ -271,7 +289,7 @@ static int readprint_raw(ITarget* mm, uint64_t offset, unsigned size)
 	return write(STDOUT_FILENO, &v, size);
 }
 
-static RwmemOp parse_op(const string& arg_str, const RegisterFile* regfile)
+RwmemOp parse_op(const string& arg_str, const RegisterFile* regfile)
 {
 	RwmemOptsArg arg;
 
@@ -387,9 +405,159 @@ static RwmemOp parse_op(const string& arg_str, const RegisterFile* regfile)
 		op.value_valid = true;
 	}
 
+	op.wait = arg.wait;
+
 	return op;
 }
 
+// The target address range of a numeric range or whole block op
+void get_op_range(const RwmemOp& op, uint64_t* addr, uint64_t* length)
+{
+	if (op.rbd) {
+		ERR_ON(!op.rds.empty(), "Operation requires a block or an address range");
+
+		*addr = rwmem_opts.ignore_base ? 0 : op.rbd->offset();
+		*length = op.rbd->size();
+	} else {
+		*addr = op.reg_offset;
+		*length = op.range;
+	}
+}
+
+// Only mmap targets can be accessed from several threads at once
+unsigned range_threads()
+{
+	if (rwmem_opts.target_type != TargetType::MMap || !rwmem_opts.trace_file.empty())
+		return 1;
+
+	return max(rwmem_opts.threads, 1u);
+}
+
+/*
+ * Serves reads from values fetched beforehand, so that targets which batch
+ * their accesses, see ITarget::batches_reads(), read a whole block at once.
+ * Consecutive registers are fetched with one read_block() into a flat
+ * buffer, scattered ones with one read_batch().
+ */
+class PrefetchTarget : public ITarget
+{
+public:
+	PrefetchTarget(ITarget* target, uint64_t addr, unsigned numbytes, size_t count)
+		: m_target(target), m_base(addr), m_numbytes(numbytes), m_block(count * numbytes)
+	{
+		target->read_block(addr, numbytes, count, m_block.data());
+	}
+
+	PrefetchTarget(ITarget* target, const vector<uint64_t>& addrs, const vector<unsigned>& sizes)
+		: m_target(target), m_base(0), m_numbytes(0)
+	{
+		vector<uint64_t> values(addrs.size());
+
+		target->read_batch(addrs.data(), sizes.data(), values.data(), addrs.size());
+
+		for (size_t i = 0; i < addrs.size(); ++i)
+			m_values[addrs[i]] = values[i];
+	}
+
+	uint64_t read(uint64_t addr, unsigned numbytes) const
+	{
+		if (numbytes == m_numbytes && addr >= m_base) {
+			const uint64_t offset = addr - m_base;
+
+			if (offset % numbytes == 0 && offset < m_block.size())
+				return get_host(&m_block[offset], numbytes);
+		} else if (!m_values.empty()) {
+			auto it = m_values.find(addr);
+
+			if (it != m_values.end())
+				return it->second;
+		}
+
+		return m_target->read(addr, numbytes);
+	}
+
+	void write(uint64_t addr, unsigned numbytes, uint64_t value) { m_target->write(addr, numbytes, value); }
+
+	uint32_t read32(uint64_t addr) const { return read(addr, 4); }
+	void write32(uint64_t addr, uint32_t value) { write(addr, 4, value); }
+
+	void map(uint64_t offset, uint64_t length) { m_target->map(offset, length); }
+	void unmap() { m_target->unmap(); }
+
+private:
+	ITarget* m_target;
+
+	// Consecutive registers of m_numbytes from m_base, as host order values
+	uint64_t m_base;
+	unsigned m_numbytes;
+	vector<uint8_t> m_block;
+
+	unordered_map<uint64_t, uint64_t> m_values;
+};
+
+// Raw dumps, and reads and writes with no output, split across worker threads
+static void do_op_numeric_parallel(const RwmemOp& op, ITarget* mm, unsigned num_threads)
+{
+	const unsigned size = rwmem_opts.data_size;
+
+	ParallelRange pr(op.reg_offset, op.range, range_chunk_size, num_threads);
+
+	vector<vector<uint8_t>> bufs(pr.num_slots());
+
+	auto work = [&](const RangeChunk& c) {
+		vector<uint8_t>& buf = bufs[c.slot];
+
+		if (rwmem_opts.raw_output) {
+			buf.resize(c.length);
+			mm->read_block(c.addr, size, c.length / size, buf.data());
+			return;
+		}
+
+		for (uint64_t offset = 0; offset < c.length; offset += size) {
+			const uint64_t addr = c.addr + offset;
+
+			if (op.value_valid && rwmem_opts.write_mode != WriteMode::Write &&
+			    mm->atomic_updates()) {
+				mm->update_bits(addr, size, GENMASK(op.high, op.low), op.value << op.low);
+			} else {
+				uint64_t v = 0;
+
+				if (rwmem_opts.write_mode != WriteMode::Write)
+					v = mm->read(addr, size);
+
+				if (!op.value_valid)
+					continue;
+
+				v &= ~GENMASK(op.high, op.low);
+				v |= op.value << op.low;
+
+				mm->write(addr, size, v);
+			}
+
+			if (rwmem_opts.write_mode == WriteMode::ReadWriteRead)
+				mm->read(addr, size);
+		}
+	};
+
+	auto done = [&](const RangeChunk& c) {
+		if (!rwmem_opts.raw_output)
+			return;
+
+		const vector<uint8_t>& buf = bufs[c.slot];
+
+		for (size_t pos = 0; pos < buf.size(); ) {
+			ssize_t l = write(STDOUT_FILENO, &buf[pos], buf.size() - pos);
+			ERR_ON_ERRNO(l == -1, "write failed");
+			pos += l;
+		}
+	};
+
+	pr.run(rwmem_opts.raw_output, work, done);
+}
+
+// Registers read per batch by numeric ops, bounding the memory for large ranges
+static const size_t numeric_batch_regs = 1024;
+
 static void do_op_numeric(const RwmemOp& op, ITarget* mm)
 {
 	const uint64_t op_base = op.reg_offset;
@@ -397,17 +565,42 @@ static void do_op_numeric(const RwmemOp& op, ITarget* mm)
 
 	mm->map(op_base, range);
 
+	const unsigned num_threads = range_threads();
+
+	if (num_threads > 1 && range > range_chunk_size &&
+	    (rwmem_opts.raw_output || rwmem_opts.print_mode == PrintMode::Quiet) &&
+	    op_base % rwmem_opts.data_size == 0 && range % rwmem_opts.data_size == 0) {
+		do_op_numeric_parallel(op, mm, num_threads);
+		return;
+	}
+
 	RwmemFormatting formatting;
 	formatting.name_chars = 30;
 	formatting.address_chars = op_base > 0xffffffff ? 16 : 8;
 	formatting.offset_chars = DIV_ROUND_UP(fls(range), 4);
 	formatting.value_chars = rwmem_opts.data_size * 2;
 
+	// Ops that only read get their registers a batch at a time from
+	// targets that batch reads
+	const bool prefetch = mm->batches_reads() && !op.value_valid &&
+			      (rwmem_opts.raw_output || rwmem_opts.write_mode != WriteMode::Write);
+
+	ITarget* const target = mm;
+	unique_ptr<PrefetchTarget> prefetched;
+
 	uint64_t op_offset = 0;
 
 	while (op_offset < range) {
 		unsigned access_size = rwmem_opts.data_size;
 
+		if (prefetch && op_offset % (numeric_batch_regs * access_size) == 0) {
+			const size_t count = min((uint64_t)numeric_batch_regs,
+						 DIV_ROUND_UP(range - op_offset, access_size));
+
+			prefetched = make_unique<PrefetchTarget>(target, op_base + op_offset, access_size, count);
+			mm = prefetched.get();
+		}
+
 		if (rwmem_opts.raw_output)
 			readprint_raw(mm, op_base + op_offset, access_size);
 		else
@@ -417,6 +610,14 @@ static void do_op_numeric(const RwmemOp& op, ITarget* mm)
 	}
 }
 
+struct SymbolicAccess
+{
+	uint64_t offset;
+	unsigned size;
+	const RegisterData* rd;
+	bool skip;
+};
+
 static void do_op_symbolic(const RwmemOp& op, const RegisterFile* regfile, ITarget* mm)
 {
 	const RegisterBlockData* rbd = op.rbd;
@@ -438,6 +639,8 @@ static void do_op_symbolic(const RwmemOp& op, const RegisterFile* regfile, ITarg
 	// Accessing addresses not defined in regfile may cause problems. So skip those.
 	const bool skip_undefined_regs = true;
 
+	vector<SymbolicAccess> accesses;
+
 	if (op.rds.empty()) {
 		uint64_t op_offset = 0;
 
@@ -451,28 +654,12 @@ static void do_op_symbolic(const RwmemOp& op, const RegisterFile* regfile, ITarg
 			else
 				access_size = rd ? rd->size() : rwmem_opts.data_size;
 
-			if (!rd && skip_undefined_regs) {
-				if (rwmem_opts.raw_output) {
-					uint64_t v = 0;
-					ssize_t l = write(STDOUT_FILENO, &v, access_size);
-					ERR_ON_ERRNO(l == -1, "write failed");
-				}
-
-				op_offset += access_size;
-				continue;
-			}
-
-			if (rwmem_opts.raw_output)
-				readprint_raw(mm, rb_access_base + op_offset, access_size);
-			else
-				readwriteprint(op, mm, rb_access_base + op_offset, rb_base + op_offset, access_size, rfd, rbd, rd, formatting);
+			accesses.push_back(SymbolicAccess { op_offset, access_size, rd, !rd && skip_undefined_regs });
 
 			op_offset += access_size;
 		}
 	} else {
 		for (const RegisterData* rd : op.rds) {
-			uint64_t op_offset = rd->offset();
-
 			unsigned access_size;
 
 			if (rwmem_opts.user_data_size)
@@ -480,22 +667,222 @@ static void do_op_symbolic(const RwmemOp& op, const RegisterFile* regfile, ITarg
 			else
 				access_size = rd->size();
 
-			if (rwmem_opts.raw_output)
-				readprint_raw(mm, rb_access_base + op_offset, access_size);
-			else
-				readwriteprint(op, mm, rb_access_base + op_offset, rb_base + op_offset, access_size, rfd, rbd, rd, formatting);
+			accesses.push_back(SymbolicAccess { rd->offset(), access_size, rd, false });
 		}
 	}
+
+	unique_ptr<PrefetchTarget> prefetched;
+
+	// Ops that only read get all their registers with one batch from
+	// targets that batch reads
+	if (mm->batches_reads() && !op.value_valid &&
+	    (rwmem_opts.raw_output || rwmem_opts.write_mode != WriteMode::Write)) {
+		vector<uint64_t> addrs;
+		vector<unsigned> sizes;
+
+		for (const SymbolicAccess& a : accesses) {
+			if (a.skip)
+				continue;
+
+			addrs.push_back(rb_access_base + a.offset);
+			sizes.push_back(a.size);
+		}
+
+		prefetched = make_unique<PrefetchTarget>(mm, addrs, sizes);
+		mm = prefetched.get();
+	}
+
+	for (const SymbolicAccess& a : accesses) {
+		if (a.skip) {
+			if (rwmem_opts.raw_output) {
+				uint64_t v = 0;
+				ssize_t l = write(STDOUT_FILENO, &v, a.size);
+				ERR_ON_ERRNO(l == -1, "write failed");
+			}
+
+			continue;
+		}
+
+		if (rwmem_opts.raw_output)
+			readprint_raw(mm, rb_access_base + a.offset, a.size);
+		else
+			readwriteprint(op, mm, rb_access_base + a.offset, rb_base + a.offset, a.size, rfd, rbd, a.rd, formatting);
+	}
+}
+
+// Keep a polled register out of the --i2c-cache, so that the polling sees
+// the device, and make the writes kept so far, which the device may need to
+// reach the polled state
+void cache_bypass(ITarget* mm, uint64_t addr, unsigned size)
+{
+	CachedTarget* cache = dynamic_cast<CachedTarget*>(mm);
+
+	if (cache) {
+		cache->set_volatile(addr, size);
+		cache->sync();
+	}
+}
+
+static void do_op_wait(const RwmemOp& op, const RegisterFile* regfile, ITarget* mm)
+{
+	const RegisterBlockData* rbd = op.rbd;
+	const RegisterData* rd = nullptr;
+	unsigned size = rwmem_opts.data_size;
+	uint64_t addr, paddr;
+
+	if (rbd) {
+		ERR_ON(op.rds.size() != 1, "Waiting requires a single register");
+
+		rd = op.rds[0];
+		addr = (rwmem_opts.ignore_base ? 0 : rbd->offset()) + rd->offset();
+		paddr = rbd->offset() + rd->offset();
+
+		if (!rwmem_opts.user_data_size)
+			size = rd->size();
+	} else {
+		addr = paddr = op.reg_offset;
+	}
+
+	mm->map(addr, size);
+
+	cache_bypass(mm, addr, size);
+
+	WaitResult res = wait_for_value(mm, addr, size, GENMASK(op.high, op.low), op.value << op.low,
+					op.wait == WaitCond::NotEqual, rwmem_opts.wait_timeout);
+
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	if (rd) {
+		string name = sformat("%s.%s", rbd->name(rfd), rd->name(rfd));
+		printq("%-30s ", name.c_str());
+	}
+
+	printq("0x%08" PRIx64 " = 0x%0*" PRIx64 " (", paddr, size * 2, res.value);
+
+	const FieldData* fd = rd && op.custom_field ? rd->find_field(rfd, op.high, op.low) : nullptr;
+
+	if (fd)
+		printq("%s ", fd->name(rfd));
+	else if (op.custom_field)
+		printq("%u:%u ", op.high, op.low);
+
+	printq("%s 0x%" PRIx64 " %s after %" PRIu64 ".%03" PRIu64 " us)\n",
+	       op.wait == WaitCond::Equal ? "==" : "!=", op.value,
+	       res.matched ? "matched" : "timed out",
+	       res.elapsed / 1000, res.elapsed % 1000);
+
+	if (!res.matched) {
+		fflush(stdout);
+		ERR("Timeout waiting for 0x%08" PRIx64, paddr);
+	}
 }
 
 static void do_op(const RwmemOp& op, const RegisterFile* regfile, ITarget* mm)
 {
-	if (op.rbd)
+	if (op.wait != WaitCond::None)
+		do_op_wait(op, regfile, mm);
+	else if (op.rbd)
 		do_op_symbolic(op, regfile, mm);
 	else
 		do_op_numeric(op, mm);
 }
 
+static void configure_sim(SimTarget* sim, const RegisterFile* regfile, const string& filename)
+{
+	INIReader ini;
+
+	try {
+		ini.load(filename);
+	} catch (...) {
+		ERR("Failed to load sim config '%s'", filename.c_str());
+	}
+
+	const RegisterFileData* rfd = regfile->data();
+
+	for (const string& section : ini.get_sections()) {
+		vector<string> strs = split(section, '.');
+		ERR_ON(strs.size() != 2, "Invalid sim register '%s'", section.c_str());
+
+		const RegisterBlockData* rbd = rfd->find_block(strs[0]);
+		ERR_ON(!rbd, "Failed to find register block '%s'", strs[0].c_str());
+
+		const RegisterData* rd = rbd->find_register(rfd, strs[1]);
+		ERR_ON(!rd, "Failed to find register '%s'", section.c_str());
+
+		const uint64_t addr = rbd->offset() + rd->offset();
+
+		for (const string& key : ini.get_keys(section)) {
+			uint64_t v;
+			string valstr = ini.get(section, key);
+
+			int r = parse_u64(valstr, &v);
+			ERR_ON(r, "Invalid value '%s' for %s.%s", valstr.c_str(), section.c_str(), key.c_str());
+
+			if (key == "reset")
+				sim->set_reset_value(addr, rd->size(), v);
+			else if (key == "ro")
+				sim->set_read_only(addr, rd->size(), v);
+			else if (key == "w1c")
+				sim->set_write_1_to_clear(addr, rd->size(), v);
+			else
+				ERR("Unknown sim key '%s'", key.c_str());
+		}
+	}
+}
+
+RealtimeConfig realtime_config()
+{
+	RealtimeConfig cfg;
+
+	cfg.lock_memory = rwmem_opts.realtime;
+	cfg.priority = rwmem_opts.rt_priority;
+	cfg.cpu = rwmem_opts.rt_cpu;
+
+	return cfg;
+}
+
+unique_ptr<ITarget> create_i2c_target(const string& spec, Endianness data_endianness)
+{
+	vector<string> strs = split(spec, ':');
+	ERR_ON(strs.size() != 2, "bad i2c parameter");
+
+	int r;
+	uint64_t bus, addr;
+
+	r = parse_u64(strs[0], &bus);
+	ERR_ON(r, "failed to parse i2c bus");
+
+	r = parse_u64(strs[1], &addr);
+	ERR_ON(r, "failed to parse i2c address");
+
+	auto i2c = make_unique<I2CTarget>(bus, addr,
+					  rwmem_opts.address_size, rwmem_opts.address_endianness,
+					  data_endianness);
+
+	i2c->set_page_size(rwmem_opts.i2c_page_size);
+	i2c->set_burst_len(rwmem_opts.i2c_burst_len);
+
+	return i2c;
+}
+
+// Wrap the target in a register cache, with the --volatile registers
+// resolved like the ops
+static unique_ptr<ITarget> create_cache(unique_ptr<ITarget> target, const RegisterFile* regfile)
+{
+	auto cache = make_unique<CachedTarget>(move(target), rwmem_opts.i2c_cache_write_back ?
+					       CacheMode::WriteBack : CacheMode::WriteThrough);
+
+	for (const string& s : rwmem_opts.volatile_regs) {
+		RegList regs;
+		reglist_add_op(regs, parse_op(s, regfile), regfile ? regfile->data() : nullptr, 0, ~0ULL);
+
+		for (size_t i = 0; i < regs.size(); ++i)
+			cache->set_volatile(regs.addrs[i], regs.sizes[i]);
+	}
+
+	return cache;
+}
+
 static void print_reg_matches(const RegisterFileData* rfd, const vector<RegMatch>& matches)
 {
 	for (const RegMatch& m : matches) {
@@ -553,6 +940,20 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (!rwmem_opts.history_file.empty()) {
+		do_history(rwmem_opts.history_file, regfile.get());
+		return 0;
+	}
+
+	if (!rwmem_opts.cosim_echo.empty()) {
+		do_cosim_echo(rwmem_opts.cosim_echo);
+		return 0;
+	}
+
+	// Recording is done in watch mode, once a second by default
+	if (!rwmem_opts.record_file.empty() && !rwmem_opts.watch_interval)
+		rwmem_opts.watch_interval = 1000000000;
+
 	vector<RwmemOp> ops;
 
 	for (const string& arg : rwmem_opts.args) {
@@ -576,6 +977,10 @@ int main(int argc, char **argv)
 			rwmem_opts.data_endianness = Endianness::Little;
 	}
 
+	// Before the target is created, so that its mapping is locked too
+	if (rwmem_opts.realtime || rwmem_opts.rt_cpu >= 0)
+		realtime_setup(realtime_config());
+
 	unique_ptr<ITarget> mm;
 
 	switch (rwmem_opts.target_type) {
@@ -584,33 +989,163 @@ int main(int argc, char **argv)
 		if (file.empty())
 			file = "/dev/mem";
 
-		mm = make_unique<MMapTarget>(file, rwmem_opts.data_endianness);
+		auto mmt = make_unique<MMapTarget>(file, rwmem_opts.data_endianness, rwmem_opts.mmap_cached);
+		mmt->set_flush_on_unmap(rwmem_opts.mmap_flush);
+
+		mm = move(mmt);
 		break;
 	}
 
-	case TargetType::I2C: {
-		vector<string> strs = split(rwmem_opts.i2c_target, ':');
-		ERR_ON(strs.size() != 2, "bad i2c parameter");
+	case TargetType::I2C:
+		mm = create_i2c_target(rwmem_opts.i2c_target, rwmem_opts.data_endianness);
+		break;
+
+	case TargetType::Sim: {
+		ERR_ON(!regfile, "sim-mode requires a register file");
+
+		auto sim = make_unique<SimTarget>(*regfile, rwmem_opts.data_endianness);
+
+		if (!rwmem_opts.sim_config.empty())
+			configure_sim(sim.get(), regfile.get(), rwmem_opts.sim_config);
+
+		sim->set_latency(rwmem_opts.sim_read_latency, rwmem_opts.sim_write_latency);
+
+		mm = move(sim);
+		break;
+	}
+
+	case TargetType::Dump:
+		mm = make_unique<DumpTarget>(rwmem_opts.dump_target, rwmem_opts.data_endianness);
+		break;
+
+	case TargetType::Process: {
+		vector<string> strs = split(rwmem_opts.pid_target, ':');
+		ERR_ON(strs.empty() || strs.size() > 2, "bad pid parameter");
 
 		int r;
-		uint64_t bus, addr;
+		uint64_t pid, base = 0;
 
-		r = parse_u64(strs[0], &bus);
-		ERR_ON(r, "failed to parse i2c bus");
+		r = parse_u64(strs[0], &pid);
+		ERR_ON(r, "failed to parse pid");
+		ERR_ON(pid == 0 || pid > INT_MAX, "bad pid %s", strs[0].c_str());
 
-		r = parse_u64(strs[1], &addr);
-		ERR_ON(r, "failed to parse i2c address");
+		if (strs.size() == 2) {
+			r = parse_u64(strs[1], &base);
+			ERR_ON(r, "failed to parse process base address");
+		}
 
-		mm = make_unique<I2CTarget>(bus, addr,
-					    rwmem_opts.address_size, rwmem_opts.address_endianness,
-					    rwmem_opts.data_endianness);
+		mm = make_unique<ProcessTarget>(pid, base, rwmem_opts.data_endianness);
 		break;
 	}
 
+	case TargetType::CoSim:
+		mm = make_unique<CoSimTarget>(rwmem_opts.cosim_target);
+		break;
+
 	default:
 		FAIL("bad target type");
 	}
 
+	if (rwmem_opts.search) {
+		ERR_ON(rwmem_opts.target_type != TargetType::MMap, "Search requires mmap-mode");
+
+		return do_search(ops, static_cast<MMapTarget*>(mm.get())) ? 0 : 1;
+	}
+
+	if (!rwmem_opts.checksum_type.empty()) {
+		ERR_ON(rwmem_opts.target_type != TargetType::MMap, "Checksum requires mmap-mode");
+
+		do_checksum(ops, static_cast<MMapTarget*>(mm.get()));
+		return 0;
+	}
+
+	if (!rwmem_opts.bench_tests.empty()) {
+		ERR_ON(rwmem_opts.target_type != TargetType::MMap, "Benchmark requires mmap-mode");
+
+		do_bench(ops, static_cast<MMapTarget*>(mm.get()));
+		return 0;
+	}
+
+	if (!rwmem_opts.trace_file.empty())
+		mm = make_unique<TraceTarget>(move(mm), rwmem_opts.trace_file);
+
+	// Outside the trace, so that only the accesses reaching the device
+	// are recorded
+	if (rwmem_opts.i2c_cache) {
+		ERR_ON(rwmem_opts.target_type != TargetType::I2C, "I2C cache requires i2c-mode");
+
+		// These read the same registers over and over to see them change
+		ERR_ON(rwmem_opts.watch_interval || !rwmem_opts.sample_name.empty(),
+		       "I2C cache cannot be used with watch, record or sample");
+
+		mm = create_cache(move(mm), regfile.get());
+	}
+
+	ERR_ON(!rwmem_opts.volatile_regs.empty() && !rwmem_opts.i2c_cache,
+	       "Volatile registers require --i2c-cache");
+
+	if (!rwmem_opts.verify_file.empty())
+		return do_verify(rwmem_opts.verify_file, regfile.get(), mm.get());
+
+	if (!rwmem_opts.seq_file.empty())
+		return do_sequence(rwmem_opts.seq_file, regfile.get(), mm.get());
+
+	if (!rwmem_opts.dump_file.empty()) {
+		do_dump(rwmem_opts.dump_file, ops, mm.get());
+		return 0;
+	}
+
+	if (!rwmem_opts.load_file.empty()) {
+		do_load(rwmem_opts.load_file, ops, mm.get());
+		return 0;
+	}
+
+	if (rwmem_opts.copy) {
+		do_copy(ops, mm.get());
+		return 0;
+	}
+
+	if (!rwmem_opts.snapshot_file.empty()) {
+		do_snapshot(rwmem_opts.snapshot_file, ops, regfile.get(), mm.get());
+		return 0;
+	}
+
+	if (rwmem_opts.watch_interval) {
+		do_watch(ops, regfile.get(), mm.get());
+		return 0;
+	}
+
+	if (rwmem_opts.profile_iterations) {
+		do_profile(ops, regfile.get(), mm.get());
+		return 0;
+	}
+
+	if (!rwmem_opts.sample_name.empty()) {
+		do_sample(ops, regfile.get(), move(mm));
+		return 0;
+	}
+
+	if (!rwmem_opts.replay_file.empty()) {
+		ERR_ON(!ops.empty(), "Replay does not take register arguments");
+
+		uint64_t num_divergences = 0;
+		JitterStats jitter;
+
+		uint64_t num_accesses = replay_trace(rwmem_opts.replay_file, mm.get(), !rwmem_opts.replay_fast,
+						     [&num_divergences](const TraceDivergence& d) {
+			printf("0x%08" PRIx64 " = 0x%0*" PRIx64 ", trace 0x%0*" PRIx64 " (record %" PRIu64 ")\n",
+			       d.addr, d.numbytes * 2, d.value, d.numbytes * 2, d.expected, d.index);
+			num_divergences++;
+		}, &jitter);
+
+		printf("%" PRIu64 " accesses replayed, %" PRIu64 " divergences\n", num_accesses, num_divergences);
+
+		if (rwmem_opts.realtime && jitter.count())
+			jitter.print(stderr, "replay");
+
+		return num_divergences ? 1 : 0;
+	}
+
 	for (const RwmemOp& op : ops)
 		do_op(op, regfile.get(), mm.get());
 
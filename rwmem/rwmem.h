@@ -10,6 +10,7 @@
 #include "regs.h"
 #include "inireader.h"
 #include "helpers.h"
+#include "realtime.h"
 
 enum class WriteMode {
 	Write,
@@ -27,6 +28,16 @@ enum class TargetType {
 	None,
 	MMap,
 	I2C,
+	Sim,
+	Dump,
+	Process,
+	CoSim,
+};
+
+enum class WaitCond {
+	None,
+	Equal,
+	NotEqual,
 };
 
 struct RegMatch
@@ -49,6 +60,8 @@ struct RwmemOp {
 
 	bool value_valid;
 	uint64_t value;
+
+	WaitCond wait;
 };
 
 struct RwmemOptsArg {
@@ -57,6 +70,7 @@ struct RwmemOptsArg {
 	std::string range;
 	std::string field;
 	std::string value;
+	WaitCond wait = WaitCond::None;
 };
 
 struct RwmemOpts {
@@ -64,6 +78,14 @@ struct RwmemOpts {
 
 	std::string mmap_target;
 	std::string i2c_target;
+	std::string sim_config;
+	std::string dump_target;
+	std::string pid_target;
+	std::string cosim_target;
+
+	// for sim
+	unsigned sim_read_latency;	// ns
+	unsigned sim_write_latency;	// ns
 
 	// for i2c
 	unsigned address_size = 1;	// bytes
@@ -79,6 +101,67 @@ struct RwmemOpts {
 
 	std::string regfile;
 
+	std::string trace_file;
+	std::string replay_file;
+	bool replay_fast;
+
+	std::string verify_file;
+	std::string snapshot_file;
+	std::string dump_file;
+	std::string load_file;
+
+	bool copy;
+	uint64_t copy_addr;
+	std::string copy_mmap_target;
+	std::string copy_i2c_target;
+	unsigned copy_data_size;	// bytes, 0 = same as data_size
+	Endianness copy_data_endianness;
+
+	uint64_t watch_interval;	// ns, 0 = no watch
+	std::string record_file;
+
+	std::string seq_file;
+
+	std::string history_file;
+	uint64_t history_at;		// ns since the start of the recording
+	bool history_at_valid;
+	uint64_t wait_timeout = 1000000000;	// ns
+
+	unsigned profile_iterations;	// 0 = no profiling
+	bool profile_write;
+
+	std::string sample_name;
+	uint64_t sample_interval = 10000000;	// ns
+
+	std::string bench_tests;	// empty = no benchmark
+
+	std::string cosim_echo;		// empty = no echo model
+
+	bool search;
+	uint64_t search_value;
+	uint64_t search_mask = ~0ULL;
+	bool search_unaligned;
+
+	std::string checksum_type;	// empty = no checksum
+	uint64_t checksum_chunk;	// bytes, 0 = whole range only
+
+	unsigned threads;	// 0 = default: one per CPU for search and checksum, else 1
+
+	bool realtime;
+	unsigned rt_priority;	// SCHED_FIFO priority, 0 = normal scheduling
+	int rt_cpu = -1;	// -1 = any
+
+	// for mmap
+	bool mmap_cached;
+	bool mmap_flush;
+
+	// for i2c
+	unsigned i2c_page_size;	// bytes, 0 = one register per write
+	unsigned i2c_burst_len;	// bytes, 0 = one register per read
+	bool i2c_cache;
+	bool i2c_cache_write_back;
+	std::vector<std::string> volatile_regs;
+
 	bool show_list;
 
 	std::vector<std::string> args;
@@ -101,9 +184,51 @@ void parse_arg(std::string str, RwmemOptsArg *arg);
 
 extern INIReader rwmem_ini;
 
+RwmemOp parse_op(const std::string& arg_str, const RegisterFile* regfile);
+void get_op_range(const RwmemOp& op, uint64_t* addr, uint64_t* length);
+
+// Large range operations are split into chunks of this size for the worker threads
+const uint64_t range_chunk_size = 1024 * 1024;
+unsigned range_threads();
+
+RealtimeConfig realtime_config();
+
+void cache_bypass(ITarget* mm, uint64_t addr, unsigned size);
+
+std::unique_ptr<ITarget> create_i2c_target(const std::string& spec, Endianness data_endianness);
+
+int do_verify(const std::string& filename, const RegisterFile* regfile, ITarget* mm);
+void do_snapshot(const std::string& filename, const std::vector<RwmemOp>& ops, const RegisterFile* regfile, ITarget* mm);
+
+void do_dump(const std::string& filename, const std::vector<RwmemOp>& ops, ITarget* mm);
+void do_copy(const std::vector<RwmemOp>& ops, ITarget* mm);
+void do_load(const std::string& filename, const std::vector<RwmemOp>& ops, ITarget* mm);
+
+int do_sequence(const std::string& filename, const RegisterFile* regfile, ITarget* mm);
+
+void do_watch(const std::vector<RwmemOp>& ops, const RegisterFile* regfile, ITarget* mm);
+void do_history(const std::string& filename, const RegisterFile* regfile);
+
+void do_sample(const std::vector<RwmemOp>& ops, const RegisterFile* regfile, std::shared_ptr<ITarget> mm);
+
+void do_cosim_echo(const std::string& name);
+
+void do_profile(const std::vector<RwmemOp>& ops, const RegisterFile* regfile, ITarget* mm);
+
+class MMapTarget;
+void do_bench(const std::vector<RwmemOp>& ops, MMapTarget* mm);
+uint64_t do_search(const std::vector<RwmemOp>& ops, MMapTarget* mm);
+void do_checksum(const std::vector<RwmemOp>& ops, MMapTarget* mm);
+
 void load_opts_from_ini_pre();
 void detect_platform();
 
+#define printq(format...) \
+	do { \
+		if (rwmem_opts.print_mode != PrintMode::Quiet) \
+			printf(format); \
+	} while(0)
+
 #define vprint(format...) \
 	do { \
 		if (rwmem_opts.verbose) \
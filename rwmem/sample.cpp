@@ -0,0 +1,55 @@
+#include <memory>
+#include <stdio.h>
+#include <signal.h>
+
+#include "rwmem.h"
+#include "reglist.h"
+#include "sampler.h"
+#include "helpers.h"
+
+using namespace std;
+
+static const uint32_t sample_ring_slots = 1024;
+
+static Sampler* s_sampler;
+
+static void sample_sig_handler(int sig)
+{
+	s_sampler->stop();
+}
+
+void do_sample(const vector<RwmemOp>& ops, const RegisterFile* regfile, shared_ptr<ITarget> mm)
+{
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	RegList regs;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write in sample mode");
+		reglist_add_op(regs, op, rfd, 0, ~0ULL);
+	}
+
+	reglist_prepare(regs);
+
+	ERR_ON(regs.batches.size() != 1, "Sampled registers must be within one batch");
+
+	Sampler sampler(mm, rwmem_opts.sample_name, regs.addrs, regs.sizes, sample_ring_slots);
+
+	vprint("Sampling %zu registers to '%s'\n", regs.size(), rwmem_opts.sample_name.c_str());
+
+	// Stop cleanly on signals so that the shm segment is removed
+	s_sampler = &sampler;
+
+	struct sigaction sa { };
+	sa.sa_handler = sample_sig_handler;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	if (rwmem_opts.realtime)
+		sampler.set_realtime(realtime_config());
+
+	sampler.run(rwmem_opts.sample_interval, 0);
+
+	if (rwmem_opts.realtime)
+		sampler.jitter().print(stderr, "sample");
+}
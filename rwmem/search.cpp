@@ -0,0 +1,40 @@
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "memsearch.h"
+#include "helpers.h"
+
+using namespace std;
+
+uint64_t do_search(const vector<RwmemOp>& ops, MMapTarget* mm)
+{
+	const unsigned size = rwmem_opts.data_size;
+	const uint64_t mask = rwmem_opts.search_mask & GENMASK(size * 8 - 1, 0);
+
+	ERR_ON(rwmem_opts.search_value & ~mask, "Search value does not fit into the mask");
+
+	uint64_t num_found = 0;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write values in search mode");
+
+		uint64_t addr, length;
+		get_op_range(op, &addr, &length);
+
+		const unsigned address_chars = addr + length > 0xffffffff ? 16 : 8;
+
+		num_found += memsearch(mm, addr, length, size, rwmem_opts.data_endianness,
+				       rwmem_opts.search_value, mask,
+				       rwmem_opts.search_unaligned ? 1 : size, rwmem_opts.threads,
+				       [address_chars](const uint64_t* addrs, size_t count) {
+			for (size_t i = 0; i < count; ++i)
+				printf("0x%0*" PRIx64 "\n", address_chars, addrs[i]);
+
+			fflush(stdout);
+		});
+	}
+
+	vprint("%" PRIu64 " matches\n", num_found);
+
+	return num_found;
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "reglist.h"
+#include "sequence.h"
+#include "helpers.h"
+
+using namespace std;
+
+static string strip(const string& s)
+{
+	size_t b = s.find_first_not_of(" \t\r");
+	if (b == string::npos)
+		return "";
+
+	size_t e = s.find_last_not_of(" \t\r");
+	return s.substr(b, e - b + 1);
+}
+
+/*
+ * Each line is a step: an op as given on the command line, which writes,
+ * reads or, with == or !=, polls a single register or field, or
+ * "delay <time>". Polls may end with "timeout <time>", the default being
+ * --timeout.
+ */
+static SeqStep parse_step(const string& filename, unsigned linenr, const string& line,
+			  const RegisterFile* regfile)
+{
+	istringstream in(line);
+	vector<string> words;
+	string w;
+
+	while (in >> w)
+		words.push_back(w);
+
+	SeqStep s { };
+
+	if (words[0] == "delay") {
+		ERR_ON(words.size() != 2, "%s:%u: Expected 'delay <time>'", filename.c_str(), linenr);
+
+		int r = parse_duration(words[1], &s.time);
+		ERR_ON(r, "%s:%u: Invalid delay '%s'", filename.c_str(), linenr, words[1].c_str());
+
+		s.op = SeqOp::Delay;
+		return s;
+	}
+
+	RwmemOp op = parse_op(words[0], regfile);
+
+	s.time = rwmem_opts.wait_timeout;
+
+	if (words.size() == 3 && words[1] == "timeout") {
+		ERR_ON(op.wait == WaitCond::None, "%s:%u: Timeout given for a step that does not poll",
+		       filename.c_str(), linenr);
+
+		int r = parse_duration(words[2], &s.time);
+		ERR_ON(r, "%s:%u: Invalid timeout '%s'", filename.c_str(), linenr, words[2].c_str());
+	} else {
+		ERR_ON(words.size() != 1, "%s:%u: Unexpected '%s'", filename.c_str(), linenr,
+		       words[1].c_str());
+	}
+
+	RegList regs;
+	reglist_add_op(regs, op, regfile ? regfile->data() : nullptr, 0, ~0ULL);
+
+	ERR_ON(regs.size() != 1, "%s:%u: A step must access a single register",
+	       filename.c_str(), linenr);
+
+	s.addr = regs.addrs[0];
+	s.numbytes = regs.sizes[0];
+	s.mask = GENMASK(op.high, op.low) & GENMASK(s.numbytes * 8 - 1, 0);
+	s.value = (op.value << op.low) & s.mask;
+
+	if (op.wait != WaitCond::None) {
+		s.op = SeqOp::Poll;
+		s.negate = op.wait == WaitCond::NotEqual;
+	} else if (op.value_valid) {
+		s.op = SeqOp::Write;
+	} else {
+		s.op = SeqOp::Read;
+	}
+
+	return s;
+}
+
+int do_sequence(const string& filename, const RegisterFile* regfile, ITarget* mm)
+{
+	ifstream in(filename);
+	ERR_ON(!in, "Failed to open sequence file '%s'", filename.c_str());
+
+	vector<SeqStep> steps;
+	vector<string> texts;
+
+	string line;
+	unsigned linenr = 0;
+
+	while (getline(in, line)) {
+		linenr++;
+
+		line = strip(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		steps.push_back(parse_step(filename, linenr, line, regfile));
+		texts.push_back(line);
+	}
+
+	ERR_ON(steps.empty(), "No steps in sequence file '%s'", filename.c_str());
+
+	for (const SeqStep& s : steps) {
+		if (s.op == SeqOp::Poll)
+			cache_bypass(mm, s.addr, s.numbytes);
+	}
+
+	// Accurate delays need the timer slack removed even without --rt
+	if (!rwmem_opts.realtime)
+		realtime_setup(realtime_config());
+
+	vector<SeqResult> results = run_sequence(mm, steps, realtime_config().spin_ns);
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		const SeqStep& s = steps[i];
+		const SeqResult& res = results[i];
+
+		printq("[%10.3f us] %10.3f us  %-40s", res.start / 1000.0, res.duration / 1000.0,
+		       texts[i].c_str());
+
+		switch (s.op) {
+		case SeqOp::Read:
+		case SeqOp::Poll:
+			printq(" = 0x%0*" PRIx64, s.numbytes * 2, res.value);
+			break;
+
+		case SeqOp::Delay:
+			printq(" (late by %.3f us)", (res.duration - min(res.duration, s.time)) / 1000.0);
+			break;
+
+		default:
+			break;
+		}
+
+		printq("%s\n", res.ok ? "" : " timed out");
+	}
+
+	const SeqResult& last = results.back();
+
+	printq("%zu of %zu steps in %.3f us\n", results.size(), steps.size(),
+	       (last.start + last.duration) / 1000.0);
+
+	return last.ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include <fstream>
+#include <stdio.h>
+
+#include "rwmem.h"
+#include "reglist.h"
+#include "helpers.h"
+
+using namespace std;
+
+// Plain loop over flat arrays, which the compiler vectorizes
+static void masked_compare(const uint64_t* values, const uint64_t* expected, const uint64_t* masks,
+			   uint64_t* diffs, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		diffs[i] = (values[i] ^ expected[i]) & masks[i];
+}
+
+static void print_mismatch(const RegList& regs, size_t i, uint64_t diff, const RegisterFileData* rfd)
+{
+	const RegisterBlockData* rbd = regs.rbds[i];
+	const RegisterData* rd = regs.rds[i];
+	const unsigned value_chars = regs.sizes[i] * 2;
+
+	const uint64_t value = regs.values[i];
+	const uint64_t expected = regs.expected[i];
+	const uint64_t mask = regs.masks[i];
+
+	if (rd) {
+		string name = sformat("%s.%s", rbd->name(rfd), rd->name(rfd));
+		printq("%-30s ", name.c_str());
+	}
+
+	printq("0x%08" PRIx64 " = 0x%0*" PRIx64 ", expected 0x%0*" PRIx64 " (mask 0x%0*" PRIx64 ")\n",
+	       regs.paddrs[i], value_chars, value, value_chars, expected & mask, value_chars, mask);
+
+	if (!rd || rwmem_opts.print_mode != PrintMode::RegFields)
+		return;
+
+	for (unsigned fidx = 0; fidx < rd->num_fields(); ++fidx) {
+		const FieldData* fd = rd->at(rfd, fidx);
+		const uint64_t fmask = GENMASK(fd->high(), fd->low());
+
+		if (!(diff & fmask))
+			continue;
+
+		printq("  %-30s ", fd->name(rfd));
+
+		if (fd->high() == fd->low())
+			printq("   %-2d = ", fd->low());
+		else
+			printq("%2d:%-2d = ", fd->high(), fd->low());
+
+		printq("0x%" PRIx64 ", expected 0x%" PRIx64 "\n",
+		       (value & fmask) >> fd->low(), (expected & fmask) >> fd->low());
+	}
+}
+
+static string strip(const string& s)
+{
+	size_t b = s.find_first_not_of(" \t\r");
+	if (b == string::npos)
+		return "";
+
+	size_t e = s.find_last_not_of(" \t\r");
+	return s.substr(b, e - b + 1);
+}
+
+int do_verify(const string& filename, const RegisterFile* regfile, ITarget* mm)
+{
+	ifstream in(filename);
+	ERR_ON(!in, "Failed to open verify file '%s'", filename.c_str());
+
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	RegList regs;
+
+	string line;
+	unsigned linenr = 0;
+
+	while (getline(in, line)) {
+		linenr++;
+
+		line = strip(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		uint64_t mask = ~0ULL;
+
+		size_t idx = line.find('&');
+		if (idx != string::npos) {
+			string maskstr = strip(line.substr(idx + 1));
+			int r = parse_u64(maskstr, &mask);
+			ERR_ON(r, "%s:%u: Invalid mask '%s'", filename.c_str(), linenr, maskstr.c_str());
+			line = strip(line.substr(0, idx));
+		}
+
+		RwmemOp op = parse_op(line, regfile);
+
+		ERR_ON(!op.value_valid, "%s:%u: No expected value", filename.c_str(), linenr);
+
+		mask &= GENMASK(op.high, op.low);
+
+		reglist_add_op(regs, op, rfd, op.value << op.low, mask);
+	}
+
+	reglist_prepare(regs);
+	reglist_read(regs, mm, range_threads());
+
+	vector<uint64_t> diffs(regs.size());
+
+	masked_compare(regs.values.data(), regs.expected.data(), regs.masks.data(),
+		       diffs.data(), regs.size());
+
+	unsigned num_mismatches = 0;
+
+	for (size_t i = 0; i < regs.size(); ++i) {
+		if (!diffs[i])
+			continue;
+
+		print_mismatch(regs, i, diffs[i], rfd);
+		num_mismatches++;
+	}
+
+	printq("%zu registers verified, %u mismatches\n", regs.size(), num_mismatches);
+
+	return num_mismatches ? 1 : 0;
+}
+
+void do_snapshot(const string& filename, const vector<RwmemOp>& ops, const RegisterFile* regfile, ITarget* mm)
+{
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	RegList regs;
+
+	for (const RwmemOp& op : ops)
+		reglist_add_op(regs, op, rfd, 0, ~0ULL);
+
+	reglist_prepare(regs);
+	reglist_read(regs, mm, range_threads());
+
+	FILE* f = fopen(filename.c_str(), "w");
+	ERR_ON_ERRNO(!f, "Failed to open snapshot file '%s'", filename.c_str());
+
+	for (size_t i = 0; i < regs.size(); ++i) {
+		const unsigned value_chars = regs.sizes[i] * 2;
+
+		if (regs.rds[i] && !rwmem_opts.user_data_size)
+			fprintf(f, "%s.%s=0x%0*" PRIx64 "\n",
+				regs.rbds[i]->name(rfd), regs.rds[i]->name(rfd),
+				value_chars, regs.values[i]);
+		else
+			fprintf(f, "0x%08" PRIx64 "=0x%0*" PRIx64 "\n",
+				regs.addrs[i], value_chars, regs.values[i]);
+	}
+
+	fclose(f);
+}
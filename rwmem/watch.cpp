@@ -0,0 +1,200 @@
+#include <errno.h>
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "rwmem.h"
+#include "reglist.h"
+#include "timeseries.h"
+#include "helpers.h"
+
+using namespace std;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static volatile sig_atomic_t s_watch_stop;
+
+static void watch_sig_handler(int sig)
+{
+	s_watch_stop = 1;
+}
+
+static void print_field_change(const FieldData* fd, const RegisterFileData* rfd,
+			       uint64_t oldval, uint64_t newval, bool initial)
+{
+	const uint64_t mask = GENMASK(fd->high(), fd->low());
+
+	printq("  %-30s ", fd->name(rfd));
+
+	if (fd->high() == fd->low())
+		printq("   %-2d = ", fd->low());
+	else
+		printq("%2d:%-2d = ", fd->high(), fd->low());
+
+	if (initial)
+		printq("0x%" PRIx64 "\n", (newval & mask) >> fd->low());
+	else
+		printq("0x%" PRIx64 " -> 0x%" PRIx64 "\n",
+		       (oldval & mask) >> fd->low(), (newval & mask) >> fd->low());
+}
+
+static void print_change(const RegList& regs, size_t i, const RegisterFileData* rfd,
+			 uint64_t ts, uint64_t oldval, uint64_t newval, bool initial)
+{
+	const RegisterBlockData* rbd = regs.rbds[i];
+	const RegisterData* rd = regs.rds[i];
+	const unsigned value_chars = regs.sizes[i] * 2;
+
+	printq("[%4" PRIu64 ".%09" PRIu64 "] ", ts / 1000000000, ts % 1000000000);
+
+	if (rd) {
+		string name = sformat("%s.%s", rbd->name(rfd), rd->name(rfd));
+		printq("%-30s ", name.c_str());
+	}
+
+	if (initial)
+		printq("0x%08" PRIx64 " = 0x%0*" PRIx64 "\n",
+		       regs.paddrs[i], value_chars, newval);
+	else
+		printq("0x%08" PRIx64 " = 0x%0*" PRIx64 " -> 0x%0*" PRIx64 "\n",
+		       regs.paddrs[i], value_chars, oldval, value_chars, newval);
+
+	if (!rd || rwmem_opts.print_mode != PrintMode::RegFields)
+		return;
+
+	for (unsigned fidx = 0; fidx < rd->num_fields(); ++fidx) {
+		const FieldData* fd = rd->at(rfd, fidx);
+
+		if (initial || ((oldval ^ newval) & GENMASK(fd->high(), fd->low())))
+			print_field_change(fd, rfd, oldval, newval, initial);
+	}
+}
+
+void do_watch(const vector<RwmemOp>& ops, const RegisterFile* regfile, ITarget* mm)
+{
+	const RegisterFileData* rfd = regfile ? regfile->data() : nullptr;
+
+	RegList regs;
+
+	for (const RwmemOp& op : ops) {
+		ERR_ON(op.value_valid, "Cannot write in watch mode");
+		reglist_add_op(regs, op, rfd, 0, ~0ULL);
+	}
+
+	reglist_prepare(regs);
+
+	const uint64_t interval = rwmem_opts.watch_interval;
+	const bool rt = rwmem_opts.realtime;
+	const RealtimeConfig rt_config = realtime_config();
+
+	const uint64_t start = now_ns();
+	uint64_t deadline = start + interval;
+
+	int tfd = -1;
+
+	// Stop cleanly on signals, so that the recording and the trace are
+	// complete and the jitter is reported. Without SA_RESTART the timerfd
+	// read below is interrupted.
+	struct sigaction sa { };
+	sa.sa_handler = watch_sig_handler;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	if (!rt) {
+		// rt mode busy-waits for the read times instead of a timer
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		ERR_ON_ERRNO(tfd < 0, "Failed to create timerfd");
+
+		// Absolute, periodic timer, so that the reads do not drift
+		struct itimerspec its { };
+		its.it_interval.tv_sec = interval / 1000000000;
+		its.it_interval.tv_nsec = interval % 1000000000;
+
+		its.it_value.tv_sec = deadline / 1000000000;
+		its.it_value.tv_nsec = deadline % 1000000000;
+
+		int r = timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, nullptr);
+		ERR_ON_ERRNO(r, "Failed to set timerfd");
+	}
+
+	unique_ptr<TimeSeriesWriter> recorder;
+
+	if (!rwmem_opts.record_file.empty())
+		recorder = make_unique<TimeSeriesWriter>(rwmem_opts.record_file, regs.paddrs, regs.sizes);
+
+	reglist_read(regs, mm);
+
+	if (recorder)
+		recorder->add(0, regs.values.data());
+
+	for (size_t i = 0; i < regs.size(); ++i)
+		print_change(regs, i, rfd, 0, 0, regs.values[i], true);
+
+	fflush(stdout);
+
+	vector<uint64_t> prev = regs.values;
+	uint64_t missed = 0;
+	JitterStats jitter;
+
+	while (!s_watch_stop) {
+		uint64_t expirations = 1;
+
+		if (rt) {
+			jitter.add(sleep_until_ns(deadline, rt_config.spin_ns));
+
+			const uint64_t now = now_ns();
+
+			if (now >= deadline + interval)
+				expirations += (now - deadline) / interval;
+		} else {
+			ssize_t l = read(tfd, &expirations, sizeof(expirations));
+			if (l < 0 && errno == EINTR)
+				continue;
+
+			ERR_ON_ERRNO(l != sizeof(expirations), "Failed to read timerfd");
+		}
+
+		deadline += expirations * interval;
+
+		if (expirations > 1) {
+			missed += expirations - 1;
+			vprint("watch: missed %" PRIu64 " intervals\n", missed);
+		}
+
+		reglist_read(regs, mm);
+
+		const uint64_t ts = now_ns() - start;
+
+		if (recorder)
+			recorder->add(ts, regs.values.data());
+
+		bool changed = false;
+
+		for (size_t i = 0; i < regs.size(); ++i) {
+			if (regs.values[i] == prev[i])
+				continue;
+
+			print_change(regs, i, rfd, ts, prev[i], regs.values[i], false);
+			prev[i] = regs.values[i];
+			changed = true;
+		}
+
+		if (changed)
+			fflush(stdout);
+	}
+
+	fflush(stdout);
+
+	if (tfd >= 0)
+		close(tfd);
+
+	if (rt)
+		jitter.print(stderr, "watch");
+}